@@ -3,32 +3,87 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <PoseKernels.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
 
+#define MAX_CURSOR_STEPS 4			// Maximum number of keyframes a cursor walks forward before falling back to binary search
+#define TRACK_TOLERANCE 1e-4f		// Maximum (relative) difference for translation and scale keyframes to be considered equal at import
+#define TRACK_ROTATION_TOLERANCE 1e-3f	// Maximum angle (radians) for rotation keyframes to be considered equal at import
+#define RESAMPLE_TOLERANCE 1e-2f	// Default maximum resampling error of translations (scene units) and scales
+#define RESAMPLE_ROTATION_TOLERANCE 1e-2f	// Default maximum resampling error of rotations (radians)
+#define COMPRESSION_TOLERANCE 1e-3f	// Default maximum compression error (bone space distance, scene units)
+#define COMPRESSION_MIN_BITS 4		// Smallest number of bits per quantized keyframe component
+#define COMPRESSION_MAX_BITS 16		// Largest number of bits per quantized keyframe component
+
+/// <summary>
+/// Track types of a channel, each track has its own keyframes
+/// </summary>
+enum Track_Type {
+	TRACK_TRANSLATION,
+	TRACK_ROTATION,
+	TRACK_SCALE,
+	TRACK_COUNT
+};
+
+/// <summary>
+/// How a track is evaluated, static tracks are detected at import and never interpolated
+/// </summary>
+enum Track_Mode {
+	TRACK_ANIMATED,					// Keyframes are interpolated
+	TRACK_CONSTANT,					// A single keyframe, used as is
+	TRACK_IDENTITY,					// No keyframes, the identity value is used
+	TRACK_BIND_POSE					// No keyframes, the value of the bind pose of the joint is used
+};
+
 /// <summary>
-/// Scale, Rotation, Time and Translation data for a keyframe
+/// Interpolation between keyframes, selects the sampler policy of the pose pipeline (see PosePipeline.hpp)
 /// </summary>
-struct SQT {
-	double time;					// Time of Keyframe
+enum Interpolation_Mode {
+	INTERPOLATION_STEP,				// Holds the keyframe at the start of the segment (StepSampler)
+	INTERPOLATION_LINEAR,			// Lerp for translation and scale, slerp for rotations (LinearSampler)
+	INTERPOLATION_CUBIC				// Catmull-Rom for translation and scale, SQUAD for rotations (CubicSampler)
+};
 
-	// Keyframe Data
-	glm::vec3 scale;
-	glm::quat rotation;
-	glm::vec3 translation;
+/// <summary>
+/// Keyframe range of a single track in the (per track type) keyframe arrays of an AnimationClip.
+/// Compressed tracks store their keyframes in the bit stream of the clip instead (see AnimationClip::Compress)
+/// </summary>
+struct AnimationTrack {
+	int first_key = 0;				// Index of the first keyframe in the clip arrays
+	int key_count = 0;				// Number of keyframes in this track
+	Track_Mode mode = TRACK_IDENTITY;	// Evaluation mode of this track
+	int bit_rate = 0;				// Bits per quantized component, 0 if the track is not compressed
+	int bit_offset = 0;				// Position (in bits) of the first keyframe in the compressed stream
+	glm::vec3 range_min = glm::vec3(0.0f);		// Quantization range of compressed translation and scale keyframes
+	glm::vec3 range_extent = glm::vec3(0.0f);
+	int first_segment = -1;			// Index of the precomputed cubic data in the clip (segment polynomials or SQUAD controls), -1 if not precomputed
 };
 
 /// <summary>
-/// The Pose list for a single Bone
+/// The Tracks of a single Bone
 /// 
-/// XXX: The Bone is referred to by name
+/// The Bone is referred to by AnimationClip::channel_joints (resolved joint index) and AnimationClip::channel_map (name)
 /// </summary>
 struct AnimationPose {
-	std::vector<SQT> bonePoses;		// SQTs for each keyframe
-	std::string bone_name;			// Name of bone
+	AnimationTrack tracks[TRACK_COUNT];	// Translation, rotation and scale tracks
+	bool bind_pose = false;				// All tracks match the bind pose, the channel does not need to be evaluated
 };
 
+/// <summary>
+/// Import options for the animations of a Mesh
+/// </summary>
+struct AnimationImportSettings {
+	float sample_rate = 0.0f;				// Rate (Hz) clips are resampled to, 0 keeps the original keyframes
+	float resample_tolerance = RESAMPLE_TOLERANCE;						// Maximum resampling error of translations (scene units, depends on the asset) and scales
+	float resample_rotation_tolerance = RESAMPLE_ROTATION_TOLERANCE;	// Maximum resampling error of rotations (radians)
+	float compression_tolerance = 0.0f;		// Maximum compression error (bone space distance), 0 keeps full precision keyframes
+};
+
+class Skeleton;
+
 /// <summary>
 /// The AnimationClip class contains all data associated with an animation.
 /// </summary>
@@ -36,19 +91,256 @@ class AnimationClip {
 public:
 	double duration;									// Animation duration
 	double ticks_per_second;							// Ticks per second
-	std::map<std::string, AnimationPose> poseSamples;	// Map from bone name to AnimationPose
+	float sample_rate = 0.0f;							// Keyframe rate (Hz) of resampled clips, 0 if keyframe times are stored
+	std::vector<AnimationPose> channels;				// AnimationPose for each animated node (channel)
+	std::vector<int> channel_joints;					// Skeleton joint index for each channel, -1 if the node is not in the skeleton
+	std::vector<SQT> channel_defaults;					// Value of the tracks without keyframes for each channel, the identity or the bind pose
+	std::map<std::string, int> channel_map;				// Map from bone name to channel index (tooling only, not used during evaluation)
+
+	// Keyframes of all channels, stored contiguously per track type (indexed by AnimationTrack)
+	// Resampled clips do not store keyframe times, keyframe i is at time i / sample_rate
+	std::vector<float> translation_times;				// Translation keyframe times (seconds)
+	std::vector<glm::vec3> translation_keys;			// Translation keyframe values
+	std::vector<float> rotation_times;					// Rotation keyframe times (seconds)
+	std::vector<glm::quat> rotation_keys;				// Rotation keyframe values
+	std::vector<float> scale_times;						// Scale keyframe times (seconds)
+	std::vector<glm::vec3> scale_keys;					// Scale keyframe values
+	std::vector<uint8_t> compressed_keys;				// Bit stream of the quantized keyframes of compressed tracks
+	std::vector<glm::vec3> cubic_segments;				// Cubic polynomial (4 coefficients) per segment of translation and scale tracks
+	std::vector<glm::quat> squad_controls;				// SQUAD control rotation per keyframe of rotation tracks
+
+	AnimationClip(std::string nameID, int n_bones, int max_frames, double duration, double ticks_per_second);
+
+	/// <summary>
+	/// Adds a new channel without keyframes.
+	/// Keyframes of a channel must be added before keyframes of the next channel, so tracks stay contiguous
+	/// </summary>
+	/// <param name="bone_name">: name of the animated bone</param>
+	/// <returns>The index of the new channel, or -1 if the bone already has a channel</returns>
+	int AddChannel(const std::string& bone_name);
+
+	// Append a keyframe to a track of the given channel
+	void AddTranslationKey(int channel, float time, const glm::vec3& translation);
+	void AddRotationKey(int channel, float time, const glm::quat& rotation);
+	void AddScaleKey(int channel, float time, const glm::vec3& scale);
+
+	/// <summary>
+	/// Returns the keyframe times array of a track type
+	/// </summary>
+	const std::vector<float>& GetTrackTimes(Track_Type type) const;
+
+	/// <summary>
+	/// Resolves every channel to a joint index of the skeleton, so evaluation does not need any name lookups
+	/// </summary>
+	/// <param name="skeleton">: the skeleton the clip is played on</param>
+	void BindChannels(const Skeleton& skeleton);
+
+	/// <summary>
+	/// Detects tracks that do not change over the whole clip and stores them as a single keyframe,
+	/// or without keyframes if they match the identity or the bind pose of the joint.
+	/// Must be called after BindChannels, once all keyframes are added
+	/// </summary>
+	/// <param name="skeleton">: the skeleton the clip is bound to</param>
+	/// <returns>The number of removed keyframes</returns>
+	int EliminateStaticTracks(const Skeleton& skeleton);
 
-	AnimationClip(std::string nameID, int n_bones, int max_frames, double duration, double ticks_per_second, std::map<std::string, AnimationPose > poseSamples);
+	/// <summary>
+	/// Resamples all animated tracks to keyframes at a fixed rate, so sampling does not need to search keyframe times.
+	/// Must be called before EliminateStaticTracks. The clip is left unchanged if the error exceeds the tolerance
+	/// </summary>
+	/// <param name="rate">: the new keyframe rate (Hz)</param>
+	/// <param name="tolerance">: maximum translation (scene units) and scale error at the original keyframes</param>
+	/// <param name="rotation_tolerance">: maximum rotation error at the original keyframes (radians)</param>
+	/// <param name="max_error">: receives the largest translation and scale error found, may be nullptr</param>
+	/// <param name="max_rotation_error">: receives the largest rotation error found, may be nullptr</param>
+	/// <returns>true if the clip was resampled</returns>
+	bool Resample(float rate, float tolerance, float rotation_tolerance, float* max_error = nullptr, float* max_rotation_error = nullptr);
+
+	/// <summary>
+	/// Quantizes the keyframes of all tracks into a bit stream and releases the full precision keyframes.
+	/// Rotations are stored as their smallest three components, translations and scales relative to the range of their track.
+	/// Every track gets the smallest bit rate that keeps the error of its joint within the tolerance, measured as the distance
+	/// points at the length of the bone (in bone space) move. Must be called last, after Resample and EliminateStaticTracks
+	/// </summary>
+	/// <param name="skeleton">: the skeleton the clip is bound to</param>
+	/// <param name="tolerance">: maximum error (bone space distance, scene units)</param>
+	/// <returns>The largest error of the compressed keyframes</returns>
+	float Compress(const Skeleton& skeleton, float tolerance);
+
+	/// <summary>
+	/// Precomputes the cubic polynomial of every segment of the animated translation and scale tracks,
+	/// so cubic sampling is a single polynomial evaluation instead of fetching four keyframes.
+	/// Rotation tracks get a SQUAD control rotation per keyframe, so cubic rotations only need three slerps.
+	/// Compressed tracks are skipped to keep their memory small, they build the polynomial (or controls) while sampling.
+	/// Must be called last, after Compress
+	/// </summary>
+	void PrecomputeCubicSegments();
+
+	/// <summary>
+	/// Returns the SQUAD control rotation of a precomputed rotation keyframe (see PrecomputeCubicSegments)
+	/// </summary>
+	/// <param name="track">: a rotation track with precomputed controls</param>
+	/// <param name="key">: the keyframe index, relative to the track</param>
+	inline const glm::quat& GetSquadControl(const AnimationTrack& track, int key) const
+	{
+		return squad_controls[track.first_segment + key];
+	}
+
+	/// <summary>
+	/// Calculates the SQUAD control rotation of a keyframe from its neighbours, which makes the curve tangent continuous
+	/// </summary>
+	/// <param name="previous_key">: the previous keyframe (the keyframe itself for the first one)</param>
+	/// <param name="key">: the keyframe</param>
+	/// <param name="next_key">: the next keyframe (the keyframe itself for the last one)</param>
+	static glm::quat ComputeSquadControl(const glm::quat& previous_key, const glm::quat& key, const glm::quat& next_key);
+
+	/// <summary>
+	/// Returns the 4 coefficients of a precomputed segment (see PrecomputeCubicSegments)
+	/// </summary>
+	/// <param name="track">: a track with precomputed segments</param>
+	/// <param name="segment">: the segment index, as returned by FindSegment</param>
+	inline const glm::vec3* GetCubicSegment(const AnimationTrack& track, int segment) const
+	{
+		return &cubic_segments[static_cast<size_t>(track.first_segment + segment) * 4];
+	}
+
+	/// <summary>
+	/// Returns the memory used by the keyframes of the clip (bytes)
+	/// </summary>
+	size_t GetKeyframeMemory() const;
+
+	// Read keyframe key (relative to the track) of a track, decompressing it from the bit stream if needed
+	inline void GetKey(Track_Type type, const AnimationTrack& track, int key, glm::vec3& value) const
+	{
+		if (track.bit_rate > 0)
+			value = DecompressVector(track, key);
+		else
+			value = type == TRACK_TRANSLATION ? translation_keys[track.first_key + key] : scale_keys[track.first_key + key];
+	}
+
+	inline void GetKey(Track_Type type, const AnimationTrack& track, int key, glm::quat& value) const
+	{
+		value = track.bit_rate > 0 ? DecompressRotation(track, key) : rotation_keys[track.first_key + key];
+	}
+
+	/// <summary>
+	/// Looks up a channel by bone name. Slow, should not be used during evaluation
+	/// </summary>
+	/// <param name="bone_name">: the bone name</param>
+	/// <returns>A pointer to the channel, or nullptr if the bone is not animated</returns>
+	const AnimationPose* FindChannel(const std::string& bone_name) const;
+
+	/// <summary>
+	/// Finds the keyframe segment [i, i + 1] of a track that contains the given time.
+	/// When a cursor is given, the search continues forward from the segment found in the previous call,
+	/// which makes lookup O(1) during normal playback. Seeking and looping fall back to binary search.
+	/// </summary>
+	/// <param name="times">: the keyframe times of the track type</param>
+	/// <param name="track">: the track to search in</param>
+	/// <param name="time">: the animation time</param>
+	/// <param name="cursor">: the cursor of this track, updated with the found segment. May be nullptr</param>
+	/// <returns>The index (relative to the track) of the first keyframe of the segment</returns>
+	static int FindKeyframe(const std::vector<float>& times, const AnimationTrack& track, double time, int* cursor);
+
+	/// <summary>
+	/// Calculates the interpolation factor between two keyframes, clamped to [0, 1]
+	/// </summary>
+	static float GetInterpolationFactor(float key_time, float next_key_time, double time);
+
+	/// <summary>
+	/// Finds the keyframe segment of an animated track at the given time, and the interpolation factor within it.
+	/// Resampled clips only need index arithmetic, other clips search the keyframe times (see FindKeyframe)
+	/// </summary>
+	/// <param name="type">: the track type</param>
+	/// <param name="track">: the track to search in</param>
+	/// <param name="time">: the animation time</param>
+	/// <param name="cursor">: the cursor of this track, may be nullptr. Not used by resampled clips</param>
+	/// <param name="factor">: receives the interpolation factor</param>
+	/// <returns>The index (relative to the track) of the first keyframe of the segment</returns>
+	int FindSegment(Track_Type type, const AnimationTrack& track, double time, int* cursor, float* factor) const;
+
+	// Interpolate between two keyframe values, linear for vectors and spherical for rotations
+	static inline glm::vec3 InterpolateKeys(const glm::vec3& key, const glm::vec3& next_key, float t)
+	{
+		return key + t * (next_key - key);
+	}
+
+	static inline glm::quat InterpolateKeys(const glm::quat& key, const glm::quat& next_key, float t)
+	{
+		return glm::normalize(glm::slerp(key, next_key, t));			// SLERP IS THE WAY!
+	}
+
+	// Spherical quadrangle interpolation between two rotation keyframes, using their control rotations (see ComputeSquadControl)
+	static inline glm::quat InterpolateKeys(const glm::quat& key, const glm::quat& next_key, const glm::quat& control, const glm::quat& next_control, float t)
+	{
+		return InterpolateKeys(InterpolateKeys(key, next_key, t), InterpolateKeys(control, next_control, t), 2.0f * t * (1.0f - t));
+	}
+
+	/// <summary>
+	/// Samples the local SQT of every animated channel at the given time into a SoA batch, with the skeleton joint of each entry.
+	/// Channels outside the skeleton or in bind pose are skipped, so the caller starts from the bind pose. Must be called after BindChannels
+	/// </summary>
+	/// <param name="time">: the animation time</param>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="pose">: receives the sampled SQTs, cleared first</param>
+	/// <param name="key_cursors">: optional keyframe cursors (TRACK_COUNT per channel), (re)allocated when they do not match the clip</param>
+	/// <param name="joint_lod">: optional highest animation LOD of each skeleton joint, joints below lod are skipped</param>
+	/// <param name="lod">: the animation LOD, only used with joint_lod</param>
+	void Evaluate(double time, Interpolation_Mode interpolation, SQTBatch& pose, std::vector<int>* key_cursors = nullptr, const int* joint_lod = nullptr, int lod = 0) const;
+
+	/// <summary>
+	/// Evaluate with the interpolation chosen at compile time. Sampler is a sampler policy of PosePipeline.hpp
+	/// (StepSampler, LinearSampler or CubicSampler), instantiated for those in AnimationClip.cpp
+	/// </summary>
+	template <typename Sampler>
+	void Evaluate(double time, SQTBatch& pose, std::vector<int>* key_cursors = nullptr, const int* joint_lod = nullptr, int lod = 0) const;
+
+	/// <summary>
+	/// Samples the clip at many times in a single pass, like Evaluate for every time.
+	/// Every track is sampled at all times before moving on, so its keyframes stay in cache, and ascending times never search keyframes.
+	/// Meant for baking, tools and crowds that play the same clip
+	/// </summary>
+	/// <param name="times">: the animation times</param>
+	/// <param name="time_count">: the number of times</param>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="poses">: one batch per time, each cleared first</param>
+	void Evaluate(const double* times, int time_count, Interpolation_Mode interpolation, SQTBatch* poses) const;
+
+	template <typename Sampler>
+	void Evaluate(const double* times, int time_count, SQTBatch* poses) const;
+
+	/// <summary>
+	/// Writes the SQTs of a single keyframe into a SoA batch, without interpolation. Tracks with fewer keyframes use their last one
+	/// </summary>
+	/// <param name="frame">: the keyframe index</param>
+	/// <param name="pose">: receives the SQTs, cleared first</param>
+	void EvaluateKeyframe(int frame, SQTBatch& pose) const;
+
+	// Sample a single track with a sampler policy, tracks without keyframes return default_value and static tracks are never interpolated
+	template <typename Sampler, typename T>
+	inline T SampleTrack(Track_Type type, const AnimationTrack& track, double time, int* cursor, const T& default_value) const
+	{
+		T value;
+		if (track.mode == TRACK_ANIMATED)
+			Sampler::Sample(*this, type, track, time, cursor, value);
+		else if (track.mode == TRACK_CONSTANT)
+			GetKey(type, track, 0, value);
+		else
+			value = default_value;
+
+		return value;
+	}
 
 	// TODO: Implement Functions
-	glm::mat4 Evaluate(double time, AnimationPose& tgt_pose);
-	glm::mat4 Evaluate(int frame);
 	void Play();
 	void Pause();
 	void Reset();
 	int GetFrameNum();
 	 
 private:
+	glm::vec3 DecompressVector(const AnimationTrack& track, int key) const;
+	glm::quat DecompressRotation(const AnimationTrack& track, int key) const;
+
 	std::string nameID;											// Name of animation (currently not used)
 	int n_bones;												// Number of bones in animation
 	int max_frames;												// Maximum number of keyframes in a channel
@@ -3,6 +3,21 @@
 #include <AnimationClip.hpp>
 #include <Mesh.hpp>
 
+#define LOD_HALF_SCREEN_SIZE 0.25f		// Instances smaller than this share of the screen height are evaluated every 2nd frame
+#define LOD_QUARTER_SCREEN_SIZE 0.1f	// Instances smaller than this share of the screen height are evaluated every 4th frame
+
+/// <summary>
+/// A clip blended over the base clip of an AnimationPlayer, optionally only on some joints
+/// </summary>
+struct AnimationLayer {
+	int anim_index = 0;						// Animation index
+	const AnimationClip* clip = nullptr;	// Clip of anim_index, owned by the target mesh
+	double time = 0.0;						// Animation time of this layer
+	float weight = 1.0f;					// Blend weight, 0 disables the layer
+	std::vector<float> bone_mask;			// Weight per skeleton joint (multiplied with weight), empty applies the layer to all joints
+	std::vector<int> key_cursors;			// Keyframe cursors of this layer
+};
+
 class AnimationPlayer {
 public:
 	double animation_time = 0.0;
@@ -10,6 +25,20 @@ public:
 	
 	int current_anim;				// Animation index
 	Mesh* tgt_mesh;					// Mesh
+	const AnimationClip* clip;		// Clip of current_anim, owned by tgt_mesh (nullptr if the mesh has no animations)
+	std::vector<int> key_cursors;	// Last keyframe segment per channel, so sampling continues where the previous frame left off
+	PoseBuffer pose;				// Evaluated pose of this instance, read by the render thread for upload
+	bool use_baked = false;			// Blend baked palettes instead of sampling the clip, if the mesh has them (see SetBaked)
+
+	std::vector<AnimationLayer> layers;			// Layers blended over the base clip, in order (see AddLayer)
+	const AnimationClip* fade_clip = nullptr;	// Clip faded out by CrossFade, nullptr if no cross-fade is running
+	double fade_time = 0.0;						// Animation time of the faded out clip
+	double fade_elapsed = 0.0;					// Time since the cross-fade started
+	double fade_duration = 0.0;					// Length of the cross-fade
+	std::vector<int> fade_cursors;				// Keyframe cursors of the faded out clip
+
+	int lod = 0;					// Animation LOD, the pose is evaluated every 2^lod frames with fewer joints (see SelectLOD)
+	int lod_phase = 0;				// Frame offset of the evaluations, so instances with the same LOD are not evaluated in the same frame
 
 	AnimationPlayer(int anim_index, Mesh* mesh);
 
@@ -33,4 +62,123 @@ public:
 	/// <param name="anim"></param>
 	/// <param name="mesh"></param>
 	void SetValues(int anim_index, Mesh* mesh);
+
+	/// <summary>
+	/// Switches between sampling the clip and blending its baked palettes, which skips the skeleton evaluation.
+	/// The player does not bake, clips are only played baked once the mesh has baked them with the interpolation
+	/// the player evaluates with (see Mesh::BakeAnimations), otherwise they are sampled
+	/// </summary>
+	/// <param name="baked">: play the baked palettes</param>
+	void SetBaked(bool baked);
+
+	/// <summary>
+	/// Selects the animation LOD for the size of an instance on screen
+	/// </summary>
+	/// <param name="screen_size">: the projected height of the instance, as share of the screen height</param>
+	/// <returns>The animation LOD, 0 for full rate</returns>
+	static int SelectLOD(float screen_size);
+
+	/// <summary>
+	/// Switches to another clip of the target mesh, fading out the current clip (which keeps playing) over the given time.
+	/// Call from the main thread, not while the player is evaluated
+	/// </summary>
+	/// <param name="anim_index">: the new animation index</param>
+	/// <param name="duration">: the length of the cross-fade, 0 switches immediately</param>
+	void CrossFade(int anim_index, double duration);
+
+	/// <summary>
+	/// Adds a clip that is blended over the base clip (and the layers added before it).
+	/// Call from the main thread, not while the player is evaluated
+	/// </summary>
+	/// <param name="anim_index">: the animation index of the layer</param>
+	/// <param name="weight">: the blend weight of the layer</param>
+	/// <param name="bone_mask">: weight per skeleton joint (see Skeleton::BuildSubtreeMask), one per joint or empty for all joints</param>
+	/// <returns>The index of the new layer in layers, or -1 if the animation does not exist or the mask does not match the skeleton</returns>
+	int AddLayer(int anim_index, float weight, const std::vector<float>& bone_mask = std::vector<float>());
+
+	/// <summary>
+	/// Removes all layers
+	/// </summary>
+	inline void ClearLayers()
+	{
+		layers.clear();
+		pose_dirty = true;
+	}
+
+	/// <summary>
+	/// Forces the next Evaluate to rebuild the pose, needed after changing layer weights or masks directly
+	/// </summary>
+	inline void Invalidate()
+	{
+		pose_dirty = true;
+	}
+
+	/// <summary>
+	/// Shows the pose of another player instead of evaluating its own (see PoseCache), for one frame.
+	/// The source has to be evaluated before the shared pose is read
+	/// </summary>
+	/// <param name="source">: the player owning the pose, nullptr to use the own pose again</param>
+	void SharePose(const AnimationPlayer* source);
+
+	/// <summary>
+	/// Returns the pose to render, which is the pose of another player while it is shared
+	/// </summary>
+	inline const PoseBuffer& GetPose() const
+	{
+		return shared_pose ? *shared_pose : pose;
+	}
+
+	/// <summary>
+	/// Returns whether the pose buffer already holds the pose Evaluate would produce, e.g. while paused.
+	/// Such players do not need to be evaluated (or dispatched) at all
+	/// </summary>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="skinning">: the palette to build</param>
+	bool IsPoseCurrent(Interpolation_Mode interpolation, Skinning_Mode skinning) const;
+
+	/// <summary>
+	/// Evaluates the pose of the target mesh at the current animation time into the pose buffer.
+	/// Returns immediately if nothing changed since the last evaluation (see IsPoseCurrent).
+	/// Above LOD 0 only every 2^lod frames are evaluated, the frames in between blend the last two evaluated palettes.
+	/// The pose then trails the animation time by one update interval, which keeps the motion smooth.
+	/// Safe to call from worker threads, as long as every player is only evaluated by one thread at a time
+	/// </summary>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="skinning">: the palette to build</param>
+	void Evaluate(Interpolation_Mode interpolation, Skinning_Mode skinning);
+
+private:
+	/// <summary>
+	/// Evaluates the pose at the current animation time, ignoring the update rate of the LOD
+	/// </summary>
+	void EvaluateFrame(Interpolation_Mode interpolation, Skinning_Mode skinning);
+
+	/// <summary>
+	/// Forgets the evaluated palettes of reduced rate updates
+	/// </summary>
+	inline void ResetLODHistory()
+	{
+		lod_history_count = 0;
+		lod_frame = 0;
+	}
+
+	const PoseBuffer* shared_pose = nullptr;	// Pose of another player shown instead of pose (see SharePose)
+
+	std::vector<SQT> blended_pose;	// Local pose the base clip, the cross-fade and the layers are blended into
+	std::vector<SQT> layer_pose;	// Local pose of the faded out clip or the current layer
+	SQTBatch layer_samples;			// Sampled channels of the clip that is blended next
+
+	PoseSnapshot lod_history[2];	// Last two evaluated palettes, blended on the frames that are not evaluated
+	int lod_history_count = 0;		// Number of valid entries in lod_history
+	int lod_newest = 0;				// Index of the last evaluated palettes in lod_history
+	unsigned int lod_frame = 0;		// Frames since the history was reset
+	Skinning_Mode lod_skinning = SKINNING_LINEAR_BLEND;	// Skinning mode the history was evaluated with
+
+	// Inputs of the pose in the pose buffer, the pose is only rebuilt if one of them changes
+	bool pose_dirty = true;							// Set by changes that are not part of the inputs below (clips, layers, baking)
+	const AnimationClip* evaluated_clip = nullptr;
+	double evaluated_time = 0.0;
+	Interpolation_Mode evaluated_interpolation = INTERPOLATION_LINEAR;
+	Skinning_Mode evaluated_skinning = SKINNING_LINEAR_BLEND;
+	int evaluated_lod = 0;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <AnimationPlayer.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Pool of worker threads that evaluate the poses of many animated instances in parallel.
+///
+/// The render thread dispatches the players of a frame, can do other work, and waits before it uploads
+/// the finished palettes (AnimationPlayer::pose). Workers never touch GL state.
+/// The same workers also split other per frame work into ranges (see DispatchRange), e.g. CPU skinning.
+/// </summary>
+class AnimationWorkerPool {
+public:
+	// Delete copy and assignment operators
+	AnimationWorkerPool(AnimationWorkerPool const&) = delete;
+	AnimationWorkerPool& operator=(AnimationWorkerPool const&) = delete;
+
+	/// <summary>
+	/// Starts the worker threads
+	/// </summary>
+	/// <param name="n_threads">: number of workers, 0 uses one worker per core except the render thread</param>
+	explicit AnimationWorkerPool(unsigned int n_threads = 0);
+	~AnimationWorkerPool();
+
+	/// <summary>
+	/// Starts evaluating the given players. Waits for the previous dispatch to finish first.
+	/// The players must stay alive and must not be modified until Wait returns
+	/// </summary>
+	/// <param name="players">: the players to evaluate</param>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="skinning">: the palettes to build</param>
+	void Dispatch(const std::vector<AnimationPlayer*>& players, Interpolation_Mode interpolation, Skinning_Mode skinning);
+
+	/// <summary>
+	/// Starts running a job over the items [0, count), in ranges of at most grain items. Waits for the previous dispatch first.
+	/// The job is called concurrently for different ranges, everything it uses must stay alive until Wait returns
+	/// </summary>
+	/// <param name="count">: the number of items</param>
+	/// <param name="grain">: the maximum number of items per call</param>
+	/// <param name="job">: called with the first and one past the last item of a range</param>
+	void DispatchRange(int count, int grain, const std::function<void(int, int)>& job);
+
+	/// <summary>
+	/// Blocks until all players (or ranges) of the last dispatch are finished
+	/// </summary>
+	void Wait();
+
+	inline unsigned int GetThreadCount() const
+	{
+		return static_cast<unsigned int>(workers.size());
+	}
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;				// Worker threads
+	std::vector<AnimationPlayer*> jobs;				// Players of the current dispatch
+	Interpolation_Mode interpolation_mode = INTERPOLATION_LINEAR;	// Settings of the current dispatch
+	Skinning_Mode skinning_mode = SKINNING_LINEAR_BLEND;
+	std::function<void(int, int)> range_job;		// Job of the current range dispatch, empty when players are evaluated
+	int range_count = 0;							// Number of items of the current range dispatch
+	int range_grain = 1;							// Number of items per range
+	int job_count = 0;								// Number of jobs (players or ranges) of the current dispatch
+
+	std::mutex mutex;								// Protects the jobs, generation, active_workers and stop
+	std::condition_variable work_available;			// Signals a new dispatch (or stop) to the workers
+	std::condition_variable work_done;				// Signals the render thread that all jobs are finished
+	unsigned int generation = 0;					// Incremented for every dispatch
+	int active_workers = 0;							// Number of workers currently taking jobs
+	bool stop = false;								// Set when the pool is destroyed
+
+	std::atomic<int> next_job;						// Index of the next job to take
+	std::atomic<int> pending_jobs;					// Number of jobs not finished yet
+};
@@ -26,7 +26,8 @@ public:
     /// </summary>
     /// <param name="expr">Expr to search for, can contain wildcard characters</param>
     /// <param name="shader">Shader to use with Asset</param>
-    void Load(std::string const& expr, Shader& shader);
+    /// <param name="import_settings">Resampling and compression of the animations</param>
+    void Load(std::string const& expr, Shader& shader, const AnimationImportSettings& import_settings = AnimationImportSettings());
 
     /// <summary>
     /// Get the list of loaded assets
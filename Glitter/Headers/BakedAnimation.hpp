@@ -0,0 +1,32 @@
+#pragma once
+
+#include <AnimationClip.hpp>
+#include <PoseKernels.hpp>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#define DEFAULT_BAKE_RATE 30.0f		// Default rate (Hz) clips are baked at
+
+/// <summary>
+/// Final skinning palettes of a clip, evaluated at a fixed rate (see Mesh::BakeAnimation).
+///
+/// Playing a baked clip only blends the two palettes around the current time, it does not sample keyframes
+/// or walk the skeleton. Meant for instances where CPU time matters more than exact sampling
+/// </summary>
+struct BakedAnimation {
+	float rate = 0.0f;									// Frames per second, 0 if the clip is not baked
+	Interpolation_Mode interpolation = INTERPOLATION_LINEAR;	// Interpolation the clip was sampled with
+	int frame_count = 0;								// Number of baked frames, the last one is at the end of the clip
+	int bone_count = 0;									// Palette entries per frame
+	int vertex_count = 0;								// Bone vertices per frame
+	std::vector<AffineTransform> palettes;				// Bone transforms of all frames, frame after frame
+	std::vector<glm::mat4x2> dual_quats;				// Bone dual quaternions of all frames, frame after frame
+	std::vector<glm::mat4> scale_transforms;			// Bone scales of all frames, frame after frame
+	std::vector<glm::vec3> bone_vertices;				// Bone vertices of all frames, frame after frame
+
+	inline bool IsBaked() const
+	{
+		return frame_count > 0;
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <AnimationWorkerPool.hpp>
+#include <PoseBuffer.hpp>
+#include <PoseKernels.hpp>
+#include <Vertex.hpp>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#define SKINNING_RANGE_SIZE 4096	// Vertices skinned by a worker at a time
+
+/// <summary>
+/// Skinned vertex attributes, one entry per vertex of the skinned mesh.
+/// Normals and tangents are transformed like in the vertex shaders, they are not normalized
+/// </summary>
+struct SkinnedVertices {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;
+
+	/// <summary>
+	/// Resizes all arrays, keeping their capacity
+	/// </summary>
+	void Resize(size_t vertex_count);
+};
+
+/// <summary>
+/// Linear blend skinning of a range of vertices on the CPU, the same result as bone_shader.vert
+/// </summary>
+/// <param name="vertices">: the vertices in bind pose</param>
+/// <param name="begin">: the first vertex of the range</param>
+/// <param name="end">: one past the last vertex of the range</param>
+/// <param name="palette">: the bone transforms (PoseBuffer::palette)</param>
+/// <param name="skinned">: receives the skinned vertices of the range, has to hold all vertices already</param>
+void SkinLinear(const Vertex* vertices, int begin, int end, const AffineTransform* palette, SkinnedVertices& skinned);
+
+/// <summary>
+/// Dual quaternion skinning of a range of vertices on the CPU, the same result as bone_dq_no_scale_shader.vert,
+/// or as bone_dq_scale_shader.vert with bone scales
+/// </summary>
+/// <param name="vertices">: the vertices in bind pose</param>
+/// <param name="begin">: the first vertex of the range</param>
+/// <param name="end">: one past the last vertex of the range</param>
+/// <param name="dual_quats">: the bone dual quaternions (PoseBuffer::dual_quats)</param>
+/// <param name="scale_transforms">: the bone scales (PoseBuffer::scale_transforms), applied before the dual quaternions, nullptr for rigid skinning</param>
+/// <param name="skinned">: receives the skinned vertices of the range, has to hold all vertices already</param>
+void SkinDualQuat(const Vertex* vertices, int begin, int end, const glm::mat4x2* dual_quats, const glm::mat4* scale_transforms, SkinnedVertices& skinned);
+
+/// <summary>
+/// Skins all vertices of a mesh with an evaluated pose, without a GL context (validation, collision, tooling).
+/// With a worker pool the vertices are split into ranges of SKINNING_RANGE_SIZE, the call returns once all of them are skinned.
+/// The pool must not be evaluating players at the same time, its previous dispatch is waited for
+/// </summary>
+/// <param name="vertices">: the vertices in bind pose (Mesh::GetVertices)</param>
+/// <param name="pose">: the evaluated pose, with the palette of the skinning mode</param>
+/// <param name="skinning">: the skinning mode, the same result as its bone shader</param>
+/// <param name="skinned">: receives the skinned vertices</param>
+/// <param name="workers">: optional worker pool</param>
+void SkinVertices(const std::vector<Vertex>& vertices, const PoseBuffer& pose, Skinning_Mode skinning, SkinnedVertices& skinned, AnimationWorkerPool* workers = nullptr);
+
+/// <summary>
+/// Skins every vertex again with a plain glm version of the bone shaders (no SIMD kernels, no workers) and compares it with
+/// the result of SkinVertices. Slow, meant for validation
+/// </summary>
+/// <param name="vertices">: the vertices in bind pose (Mesh::GetVertices)</param>
+/// <param name="pose">: the evaluated pose the vertices were skinned with</param>
+/// <param name="skinning">: the skinning mode the vertices were skinned with</param>
+/// <param name="skinned">: the result of SkinVertices</param>
+/// <returns>The largest distance of a skinned position, normal or tangent to the reference, -1 if the sizes do not match</returns>
+float ValidateSkinning(const std::vector<Vertex>& vertices, const PoseBuffer& pose, Skinning_Mode skinning, const SkinnedVertices& skinned);
@@ -10,6 +10,8 @@
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl3.h>
 
+#define MAX_INSTANCES 16    // Maximum number of rendered instances of the active mesh
+
 /// <summary>
 /// This enum stores different UI button callback types
 /// </summary>
@@ -34,11 +36,17 @@ struct SceneSettings
     bool wireframe_mode;
     bool show_bones_flag;
     bool show_skybox;
-    bool dual_quat_skinning_flag;
-    bool cubic_interpolation_flag;
+    int skinning_mode;          // Skinning_Mode
+    int interpolation_mode;     // Interpolation_Mode
+    bool baked_playback_flag;
+    bool animation_lod_flag;
+    float pose_cache_step;
+    int instance_count;
     float anim_speed;
     Asset* active_asset;
     int animation_frame;
+    int pose_cache_hits;
+    int pose_cache_misses;
 };
 
 /// <summary>
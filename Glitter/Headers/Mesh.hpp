@@ -2,6 +2,11 @@
 #include "Vertex.hpp"
 #include "Shader.hpp"
 #include "AnimationClip.hpp"
+#include "Skeleton.hpp"
+#include "PoseBuffer.hpp"
+#include "PaletteRing.hpp"
+#include "PosePipeline.hpp"
+#include "BakedAnimation.hpp"
 
 #include <vector>
 #include <memory>
@@ -10,8 +15,16 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
+#define MAX_ANIMATION_LOD 2					// Highest animation LOD, every level halves the update rate (see AnimationPlayer)
+#define LOD_HALF_MIN_INFLUENCE 0.01f		// Share of the skin weights a joint (with its subtree) needs to be animated at LOD 1
+#define LOD_QUARTER_MIN_INFLUENCE 0.05f		// Share of the skin weights a joint (with its subtree) needs to be animated at LOD 2
+
 /// <summary>
 /// Implements Meshes that were imported using Assimp
+///
+/// A Mesh is the shared asset: geometry, skeleton, bones and clips. It is not changed by evaluating poses,
+/// so any number of instances can play it at different times, each with its own PoseBuffer (see AnimationPlayer).
+/// Only explicit calls on the Mesh itself (like BakeAnimations) modify it
 /// </summary>
 class Mesh
 {
@@ -22,7 +35,7 @@ public:
 
 	// constructors
 	Mesh();
-	Mesh(std::string const& filename, Shader* shader);
+	Mesh(std::string const& filename, Shader* shader, const AnimationImportSettings& import_settings = AnimationImportSettings());
 	~Mesh();
 	void Render(glm::mat4, glm::mat4, glm::mat4, glm::vec3, glm::vec3, glm::vec3, glm::vec3, float, float, GLuint, GLuint, GLuint);
 	
@@ -41,16 +54,37 @@ public:
 	/// <param name="model">The model matrix. Doesn't make much sense at the time of writing, because we only support 1 model at a time and it's not being transformed.</param>
 	/// <param name="projection">The projection matrix</param>
 	static void RenderBones(glm::mat4, glm::mat4, glm::mat4);	
-	void Animate(int frame, std::vector<glm::vec3>* boneVertices);
 
 	/// <summary>
-	/// Traverses nodes (aiNode) in tree recursively, to calculate final transformation matrices
+	/// Evaluates the last animation of the mesh into its own pose and uploads it, for a single instance without an AnimationPlayer.
+	/// Sampler (StepSampler, LinearSampler, CubicSampler) and Output (MatrixOutput, DualQuatOutput, ScaledDualQuatOutput) are the
+	/// policies of PosePipeline.hpp, e.g. Animate<CubicSampler, DualQuatOutput>(time, &boneVertices)
+	/// </summary>
+	/// <param name="m_currentTime">: the current animation time</param>
+	/// <param name="boneVertices">: receives the bone vertices</param>
+	/// <param name="keyCursors">: optional keyframe cursors per channel (owned by the AnimationPlayer), speeds up keyframe lookup during playback</param>
+	template <typename Sampler, typename Output>
+	void Animate(double m_currentTime, std::vector<glm::vec3>* boneVertices, std::vector<int>* keyCursors = nullptr);
+
+	/// <summary>
+	/// The pose pipeline specialized at compile time: samples a clip with the Sampler policy and writes the palette of the Output policy.
+	/// Every combination is instantiated in Mesh.cpp, EvaluatePose picks one of them at runtime. Safe to call from worker threads like EvaluatePose
 	/// </summary>
-	/// <param name="frame">: the keyframe to be animated</param>
-	/// <param name="node">: the node currently processed</param>
-	/// <param name="parent_transform">: the tranformation matrix of the parent of this node</param>
+	/// <param name="pose">: the pose buffer of the instance</param>
+	/// <param name="clip">: the clip to sample, one of the animations of this mesh</param>
+	/// <param name="m_currentTime">: the current animation time</param>
+	/// <param name="keyCursors">: optional keyframe cursors of the instance</param>
+	/// <param name="lod">: the animation LOD, joints that are not animated at this LOD keep their bind pose</param>
+	/// <param name="boneVertices">: receives the bone vertices, may be nullptr for the DQ outputs</param>
+	template <typename Sampler, typename Output>
+	void EvaluatePipeline(PoseBuffer& pose, const AnimationClip& clip, double m_currentTime, std::vector<int>* keyCursors, int lod, std::vector<glm::vec3>* boneVertices) const;
+
+	/// <summary>
+	/// Concatenates the sampled local transforms down the flattened skeleton, to calculate final transformation matrices
+	/// </summary>
+	/// <param name="pose">: the sampled pose, receives the final bone transforms</param>
 	/// <param name="boneVertices">: a pointer to the vector containing all the bone vertices. Gets filled with bone vertices throughout the function</param>
-	void TraverseNode(const int frame, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices);
+	void ComputeGlobalPose(PoseBuffer& pose, std::vector<glm::vec3>* boneVertices) const;
 
 	/// <summary>
 	/// Creates the buffer objects for the skeleton, VAO & VBO.
@@ -58,71 +92,137 @@ public:
 	static void PrepareSkeletonBOs();
 
 	/// <summary>
-	/// Evaluates and animates the current frame using linear interpolation on the current time
+	/// Sends a new set of bone vertices to the GPU, into the skeleton VBO.
 	/// </summary>
-	/// <param name="m_currentTime">: the current animation time</param>
-	void AnimateLI(double m_currentTime, std::vector<glm::vec3>* boneVertices);
+	/// <param name="boneVertices"></param>
+	static void UpdateSkeletonVertices(const std::vector<glm::vec3>& boneVertices);
 
 	/// <summary>
-	/// Evaluates and animates the current frame using bicubic interpolation on the current time
+	/// Concatenates the sampled SQTs (pose.sampled_pose) down the flattened skeleton and builds the dual quaternion palette directly,
+	/// without the matrix palette. The local pose is not used, so the samples must not be composed to matrices first
 	/// </summary>
+	/// <param name="pose">: the sampled pose, receives the dual quaternions</param>
+	/// <param name="boneVertices">: receives the bone vertices, may be nullptr</param>
+	/// <param name="scale">: also write the bone scales (pose.scale_transforms) for scale-aware DQ skinning</param>
+	void ComputeDualQuatPose(PoseBuffer& pose, std::vector<glm::vec3>* boneVertices, bool scale = false) const;
+
+	/// <summary>
+	/// Evaluates the pose of an instance at the given time, up to a palette that is ready for upload.
+	/// Does not touch any GL state or Mesh data, so different PoseBuffers can be evaluated from worker threads
+	/// </summary>
+	/// <param name="pose">: the pose buffer of the instance</param>
+	/// <param name="clip">: the clip to sample, one of the animations of this mesh</param>
 	/// <param name="m_currentTime">: the current animation time</param>
-	void AnimateCI(double m_currentTime, std::vector<glm::vec3>* boneVertices);
+	/// <param name="interpolation">: the interpolation between keyframes (sampler policy)</param>
+	/// <param name="skinning">: the palette to build (output policy)</param>
+	/// <param name="keyCursors">: optional keyframe cursors of the instance</param>
+	/// <param name="lod">: the animation LOD, joints that are not animated at this LOD keep their bind pose</param>
+	void EvaluatePose(PoseBuffer& pose, const AnimationClip& clip, double m_currentTime, Interpolation_Mode interpolation, Skinning_Mode skinning, std::vector<int>* keyCursors, int lod = 0) const;
 
 	/// <summary>
-	/// Evaluates and animates the selected keyframe of the animation, using DQS
+	/// Samples the local SQT of every joint from a clip, joints without a channel keep their bind pose.
+	/// Used for blending, sampled and local only grow the first time they are used
 	/// </summary>
-	/// <param name="frame">: the keyframe to be animated</param>
-	void AnimateDualQuat(int frame, std::vector<glm::vec3>* boneVertices);
+	/// <param name="clip">: the clip to sample, one of the animations of this mesh</param>
+	/// <param name="m_currentTime">: the animation time within the clip</param>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="keyCursors">: optional keyframe cursors for this clip</param>
+	/// <param name="sampled">: scratch batch the clip is sampled into</param>
+	/// <param name="local">: receives the SQT of every skeleton joint</param>
+	/// <param name="lod">: the animation LOD, joints that are not animated at this LOD keep their bind pose</param>
+	void SampleLocalPose(const AnimationClip& clip, double m_currentTime, Interpolation_Mode interpolation, std::vector<int>* keyCursors, SQTBatch& sampled, std::vector<SQT>& local, int lod = 0) const;
 
 	/// <summary>
-	/// Evaluates and animates the current frame using linear interpolation on the current time, using DQS
+	/// Evaluates the palette of a (blended) local pose, like EvaluatePose does for a sampled clip
 	/// </summary>
-	/// <param name="m_currentTime">: the current animation time</param>
-	void AnimateLIDualQuat(double m_currentTime, std::vector<glm::vec3>* boneVertices);
+	/// <param name="pose">: the pose buffer of the instance</param>
+	/// <param name="local">: the SQT of every skeleton joint</param>
+	/// <param name="skinning">: the palette to build</param>
+	void EvaluateLocalPose(PoseBuffer& pose, const std::vector<SQT>& local, Skinning_Mode skinning) const;
 
 	/// <summary>
-	/// Evaluates and animates the current frame using bicubic interpolation on the current time
+	/// Writes the palette of an evaluated pose to the palette ring and binds it for the next draw call. Render thread only,
+	/// between paletteRing.BeginFrame and EndFrame. Skipped if the binding already holds this palette revision in the current frame
 	/// </summary>
-	/// <param name="m_currentTime">: the current animation time</param>
-	void AnimateCIDualQuat(double m_currentTime, std::vector<glm::vec3>* boneVertices);
+	/// <param name="pose">: the evaluated pose</param>
+	/// <param name="skinning">: the palette the bone shader reads, the scale-aware mode also uploads the bone scales</param>
+	/// <returns>False if the ring region of this frame is full, nothing new is bound then and the instance must not be drawn</returns>
+	bool UploadPose(const PoseBuffer& pose, Skinning_Mode skinning) const;
 
 	/// <summary>
-	/// Traverses nodes (aiNode) in tree recursively, to calculate final transformation matrices
-	/// Sends a new set of bone vertices to the GPU, into the skeleton VBO.
+	/// Evaluates the palettes of an animation at a fixed rate and stores them, so it can be played with EvaluateBakedPose.
+	/// Modifies the Mesh, must not be called while instances are evaluated
 	/// </summary>
-	/// <param name="boneVertices"></param>
-	static void UpdateSkeletonVertices(std::vector<glm::vec3> boneVertices);
+	/// <param name="index">: the index of the animation</param>
+	/// <param name="rate">: the number of baked frames per second</param>
+	/// <param name="interpolation">: the interpolation used while baking</param>
+	void BakeAnimation(int index, float rate, Interpolation_Mode interpolation);
 
 	/// <summary>
-	/// Traverses nodes (aiNode) in tree recursively, to calculate final transformation matrices using linear interpolation for SQTs
+	/// Bakes every animation that is not baked yet with the given rate and interpolation (see BakeAnimation).
+	/// Modifies the Mesh, must not be called while instances are evaluated
 	/// </summary>
-	/// <param name="m_currentTime">: the current time of the animation</param>
-	/// <param name="node">: the node currently processed</param>
-	/// <param name="parent_transform">: the tranformation matrix of the parent of this node</param>
-	void TraverseNodeLI(const double m_currentTime, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices);
+	/// <param name="rate">: the number of baked frames per second</param>
+	/// <param name="interpolation">: the interpolation used while baking</param>
+	void BakeAnimations(float rate, Interpolation_Mode interpolation);
 
 	/// <summary>
-	/// Traverses nodes (aiNode) in tree recursively, to calculate final transformation matrices using cubic interpolation for SQTs
+	/// Returns whether an animation has been baked with the given interpolation
 	/// </summary>
-	/// <param name="m_currentTime">: the current time of the animation</param>
-	/// <param name="node">: the node currently processed</param>
-	/// <param name="parent_transform">: the tranformation matrix of the parent of this node</param>
-	void TraverseNodeCI(const double m_currentTime, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices);
+	/// <param name="index">: the index of the animation</param>
+	/// <param name="interpolation">: the interpolation the palettes have to be sampled with</param>
+	bool IsAnimationBaked(int index, Interpolation_Mode interpolation) const;
 
+	/// <summary>
+	/// Blends the two baked palettes around the given time into the pose buffer, without evaluating the skeleton.
+	/// The animation must be baked. Like EvaluatePose, safe to call from worker threads
+	/// </summary>
+	/// <param name="pose">: the pose buffer of the instance</param>
+	/// <param name="index">: the index of the animation</param>
+	/// <param name="m_currentTime">: the current animation time</param>
+	/// <param name="skinning">: the skinning mode, selects the palettes that are blended</param>
+	void EvaluateBakedPose(PoseBuffer& pose, int index, double m_currentTime, Skinning_Mode skinning) const;
 
 	Shader* getShader();
 	int GetAnimationFrameNum();												// Temp!
-	bool HasAnimations();
+	bool HasAnimations() const;
 
 	/// <summary>
-	/// Returns an animation from the mesh, by index
+	/// Returns an animation from the mesh, by index.
+	/// Animations are never added or removed after import, so the pointer stays valid as long as the Mesh
 	/// </summary>
 	/// <param name="index">: the index of the animation</param>
-	/// <returns></returns>
-	AnimationClip GetAnimation(int index);
+	/// <returns>The animation, or nullptr if the index is out of range (e.g. the mesh has no animations)</returns>
+	const AnimationClip* GetAnimation(int index) const;
+
+	inline int GetAnimationCount() const
+	{
+		return static_cast<int>(m_animations.size());
+	}
+
+	inline const Skeleton& GetSkeleton() const
+	{
+		return m_skeleton;
+	}
+
+	/// <summary>
+	/// Returns the vertices in bind pose, with their bone ids and weights (e.g. for CPU skinning)
+	/// </summary>
+	inline const std::vector<Vertex>& GetVertices() const
+	{
+		return m_vertices;
+	}
+
+	/// <summary>
+	/// Returns the radius of a sphere around the origin of the mesh that contains all vertices in bind pose, used to estimate the screen size
+	/// </summary>
+	inline float GetBoundingRadius() const
+	{
+		return m_boundingRadius;
+	}
 
 	static Shader skeletonShader;			// The shader used for all skeleton rendering
+	static PaletteRing paletteRing;			// Streams the palettes of all instances to the skinning shaders (see UploadPose)
 	static unsigned int m_boneVertexCount;	// Number of vertices for rendering the bone (part of the skeleton)
 	static unsigned int m_skeletonVBO;		// A VBO containing the vertices for skeleton rendering
 	static unsigned int m_skeletonVAO;		// A VAO containing the proper setup for easy binding of the skeleton rendering render part
@@ -149,13 +249,31 @@ private:
 	void SetVertexBoneData(Vertex& vertex, int boneId, float weight);
 
 	/// <summary>
-	/// Extracts bone information and stores it in vertices
+	/// Extracts bone information and stores it in vertices, the weights of every skinned vertex are normalized to sum to 1
 	/// </summary>
 	/// <param name="vertices">: the mesh vertices</param>
 	/// <param name="mesh">: the mesh</param>
 	/// <param name="scene">: the scene of the mesh</param>
 	void ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, const aiMesh* mesh, const aiScene* scene);
 
+	/// <summary>
+	/// Decides per joint up to which animation LOD it is sampled, based on the share of the skin weights of the joint and its descendants.
+	/// Hands and fingers are dropped first, the spine and legs are always animated
+	/// </summary>
+	void BuildJointLOD();
+
+	/// <summary>
+	/// Sizes the buffers of a pose for the skeleton and bones of this mesh, if needed
+	/// </summary>
+	/// <param name="pose">: the pose buffer</param>
+	void PreparePose(PoseBuffer& pose) const;
+
+	// Composes the sampled SQTs over the bind pose into the local transforms of the matrix pipeline
+	void ComposeLocalPose(PoseBuffer& pose) const;
+
+	// Concatenates a full local pose and builds the dual quaternion palette, see ComputeDualQuatPose
+	void ConcatenateDualQuats(PoseBuffer& pose, const SQT* local, std::vector<glm::vec3>* boneVertices, bool scale = false) const;
+
 	/// <summary>
 	/// Loads textures bases on type
 	/// </summary>
@@ -201,12 +319,26 @@ private:
 	std::map<std::string, int> bone_map;										// Map connects node - bone names to indices in m_bones vector
 	std::vector<BoneInfo> m_bones;												// Is indexed by the indices in bone_map
 	std::vector<AnimationClip> m_animations;									// Animations associated with this mesh
+	std::vector<BakedAnimation> m_bakedAnimations;								// Baked palettes per animation, empty if not baked
+	AnimationImportSettings m_importSettings;									// Resampling and compression of animations at import
 	std::string dir;															// Mesh directory
 	Assimp::Importer importer;													// Assimp Importer for the scene (MUST LIVE!!!)
-	const aiScene* scene;														// Points to scene of the mesh. Needed to preserve node tree for bone transformation calculations
+	const aiScene* scene;														// Points to scene of the mesh
+	Skeleton m_skeleton;														// Flattened node tree, used for bone transformation calculations
+	PoseBuffer m_pose;															// Pose used by Animate (instances use their own)
+	std::vector<AffineTransform> m_boneOffsets;									// Offset matrix of each bone, as affine transform
+	std::vector<SQT> m_boneOffsetsSQT;											// Offset matrix of each bone, decomposed for the DQ pipeline
 	int m_boneCounter = 0;														// Number of bones in mesh rig
+	std::vector<float> m_boneInfluence;											// Sum of the vertex weights of each bone
+	std::vector<int> m_jointLOD;												// Highest animation LOD at which each joint is still sampled
+	float m_boundingRadius = 0.0f;												// Distance of the farthest vertex from the mesh origin
 	glm::mat4 inverse_transform;												// Inverse transform matrix for mesh to scene. Possibly only useful if more submeshes are used
+	AffineTransform m_inverseTransform;											// inverse_transform, as affine transform
+	SQT m_inverseTransformSQT;													// inverse_transform, decomposed for the DQ pipeline
 	Shader* shader;																// Shader used for rendering this mesh (Shader class)
+	static unsigned long long m_uploadedRevision;								// Palette revision of the last UploadPose, shared because all meshes use the same binding
+	static unsigned long long m_uploadedFrame;									// Ring frame of the last UploadPose
+	static Skinning_Mode m_uploadedSkinning;									// Skinning mode of the last UploadPose
 	std::vector<std::unique_ptr<Mesh>> m_subMeshes;								// Who knows at this point
 
 	// Buffer - Array Objects
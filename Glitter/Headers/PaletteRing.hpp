@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#define PALETTE_RING_FRAMES 3						// Frames in flight, the CPU writes one region while the GPU reads the others
+#define PALETTE_RING_FRAME_SIZE (4 * 1024 * 1024)	// Default bytes per region, about 700 palettes of 120 bones (matrices)
+#define BONE_PALETTE_BINDING 0						// Shader storage binding of the bone palette (boneTransforms)
+#define BONE_SCALE_BINDING 1						// Shader storage binding of the bone scales (scaleTransforms)
+
+/// <summary>
+/// Streams bone palettes to the GPU through a single shader storage buffer, split into one region per frame in flight.
+///
+/// Every palette is written once per frame at the next free offset of the current region and bound with glBindBufferRange,
+/// so any number of instances and bones fit, the shaders have no fixed palette size. The region of a frame is only written
+/// again after a fence shows the GPU finished reading it. A frame that overflows its region loses the palettes that did not
+/// fit, the next BeginFrame re-creates the ring with regions large enough for it.
+/// With GL 4.4 (or ARB_buffer_storage) the buffer is persistently mapped and writing a palette is a memcpy,
+/// otherwise it falls back to glBufferSubData into the same regions. Render thread only
+/// </summary>
+class PaletteRing
+{
+public:
+	PaletteRing() = default;
+
+	// The ring owns a GL buffer and its mapping
+	PaletteRing(PaletteRing const&) = delete;
+	PaletteRing& operator=(PaletteRing const&) = delete;
+
+	/// <summary>
+	/// Creates the buffer, needs a current GL 4.3 context
+	/// </summary>
+	/// <param name="frame_size">: bytes per frame region, all palettes of a frame have to fit</param>
+	void Init(GLsizeiptr frame_size = PALETTE_RING_FRAME_SIZE);
+
+	/// <summary>
+	/// Releases the buffer and the fences
+	/// </summary>
+	void Cleanup();
+
+	/// <summary>
+	/// Moves to the region of the next frame, waits until the GPU finished the frame that last used it.
+	/// Grows the regions first if the previous frame did not fit
+	/// </summary>
+	void BeginFrame();
+
+	/// <summary>
+	/// Fences the region of the current frame, call after the last draw call that reads it
+	/// </summary>
+	void EndFrame();
+
+	/// <summary>
+	/// Copies data to the next free offset of the current region
+	/// </summary>
+	/// <param name="data">: the data to copy</param>
+	/// <param name="size">: number of bytes</param>
+	/// <returns>The offset in the buffer, or -1 if the region is full (the ring grows at the next BeginFrame)</returns>
+	GLintptr Write(const void* data, GLsizeiptr size);
+
+	/// <summary>
+	/// Binds a range of the buffer to a shader storage binding
+	/// </summary>
+	void Bind(GLuint binding, GLintptr offset, GLsizeiptr size) const;
+
+	/// <summary>
+	/// Writes the data and binds it, see Write and Bind
+	/// </summary>
+	/// <returns>The offset in the buffer, or -1 if the region is full (nothing is bound then)</returns>
+	GLintptr Upload(GLuint binding, const void* data, GLsizeiptr size);
+
+	inline bool IsPersistent() const
+	{
+		return m_mapped != nullptr;
+	}
+
+	/// <summary>
+	/// Returns the number of BeginFrame calls, offsets written before the current frame are not valid anymore
+	/// </summary>
+	inline unsigned long long GetFrame() const
+	{
+		return m_frame;
+	}
+
+private:
+	GLuint m_buffer = 0;									// The shader storage buffer, PALETTE_RING_FRAMES regions of m_frameSize
+	char* m_mapped = nullptr;								// Persistent mapping of the whole buffer, nullptr for the glBufferSubData fallback
+	GLsizeiptr m_frameSize = 0;								// Bytes per region
+	GLintptr m_alignment = 256;								// GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+	GLintptr m_offset = 0;									// Next free offset within the current region
+	GLsizeiptr m_required = 0;								// Bytes the current frame asked for, including writes that did not fit
+	int m_region = 0;										// Region of the current frame
+	unsigned long long m_frame = 0;							// Frame counter, see GetFrame
+	bool m_overflowReported = false;						// A full region is only reported once per ring size
+	GLsync m_fences[PALETTE_RING_FRAMES] = {};				// Fence of the last frame that used each region
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <PoseKernels.hpp>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+/// <summary>
+/// Palette the pose is evaluated into, selects the output policy of the pose pipeline (see PosePipeline.hpp) and the bone shader
+/// </summary>
+enum Skinning_Mode {
+	SKINNING_LINEAR_BLEND,			// Matrix palette, bone_shader.vert (MatrixOutput)
+	SKINNING_DUAL_QUAT,				// Rigid dual quaternion palette, bone_dq_no_scale_shader.vert (DualQuatOutput)
+	SKINNING_SCALED_DUAL_QUAT		// Dual quaternion palette plus bone scales, bone_dq_scale_shader.vert (ScaledDualQuatOutput)
+};
+
+/// <summary>
+/// Returns whether a skinning mode reads the dual quaternion palette
+/// </summary>
+inline bool IsDualQuatSkinning(Skinning_Mode skinning)
+{
+	return skinning != SKINNING_LINEAR_BLEND;
+}
+
+/// <summary>
+/// Evaluation state and output of a single animated instance of a Mesh.
+///
+/// A Mesh only reads its own data while evaluating into a PoseBuffer, so instances with their own
+/// PoseBuffer can be evaluated on different threads at the same time. Only uploading the palette needs the GL context.
+/// Matrix and DQ skinning evaluate separate pipelines, only the palettes of the evaluated skinning mode are up to date.
+/// </summary>
+struct PoseBuffer {
+	SQTBatch sampled_pose;									// Sampled SQTs of the animated joints, composed into local_pose
+	std::vector<AffineTransform> local_pose;				// Local transform per skeleton joint
+	std::vector<AffineTransform> global_pose;				// Global transform per skeleton joint
+	std::vector<SQT> local_sqts;							// Local SQT per skeleton joint (DQ skinning)
+	std::vector<SQT> global_sqts;							// Global SQT per skeleton joint (DQ skinning)
+	std::vector<AffineTransform> palette;					// Final bone transforms, uploaded as they are (matrix skinning)
+	std::vector<glm::mat4x2> dual_quats;					// Final bone dual quaternions, ready to upload (DQ skinning)
+	std::vector<glm::mat4> scale_transforms;				// Scale of every bone, only written for SKINNING_SCALED_DUAL_QUAT
+	std::vector<glm::vec3> bone_vertices;					// Joint positions (pairs of parent and child) for skeleton rendering
+	unsigned long long revision = 0;						// Unique per written palette (see NextPoseRevision), 0 if nothing was evaluated yet
+};
+
+/// <summary>
+/// Returns a new palette revision, unique over all pose buffers. Thread safe, so workers can call it while they evaluate
+/// </summary>
+unsigned long long NextPoseRevision();
+
+/// <summary>
+/// Read only view of the final palettes of a single evaluated (or baked) frame
+/// </summary>
+struct PaletteFrame {
+	const AffineTransform* palette;							// Bone transforms, may be nullptr if they are not blended
+	const glm::mat4x2* dual_quats;							// Bone dual quaternions, may be nullptr if they are not blended
+	const glm::mat4* scale_transforms;						// Bone scales, may be nullptr if they are not blended
+	const glm::vec3* bone_vertices;							// Bone vertices for skeleton rendering
+};
+
+/// <summary>
+/// Copy of the final palettes of an evaluated frame, so later frames can be interpolated instead of evaluated
+/// </summary>
+struct PoseSnapshot {
+	std::vector<AffineTransform> palette;
+	std::vector<glm::mat4x2> dual_quats;
+	std::vector<glm::mat4> scale_transforms;
+	std::vector<glm::vec3> bone_vertices;
+	int bone_count = 0;										// Entries of the stored palette (matrices or dual quaternions)
+
+	/// <summary>
+	/// Copies the palettes of an evaluated pose that the skinning mode uses, keeping the capacity of the arrays
+	/// </summary>
+	void Store(const PoseBuffer& pose, Skinning_Mode skinning);
+
+	inline PaletteFrame GetFrame() const
+	{
+		return PaletteFrame{ palette.data(), dual_quats.data(), scale_transforms.data(), bone_vertices.data() };
+	}
+};
+
+/// <summary>
+/// Blends the palettes of two frames into the output of a pose buffer, without evaluating the skeleton.
+/// Matrices, bone scales and bone vertices are blended linearly, dual quaternions along the shortest path (the shader normalizes them)
+/// </summary>
+/// <param name="frame">: the palettes at t = 0</param>
+/// <param name="next_frame">: the palettes at t = 1</param>
+/// <param name="bone_count">: number of palette entries</param>
+/// <param name="vertex_count">: number of bone vertices</param>
+/// <param name="t">: the blend factor</param>
+/// <param name="skinning">: the skinning mode, matrix skinning blends the matrices, dual quaternion modes the dual quaternions (and the scales)</param>
+/// <param name="pose">: receives the blended palettes</param>
+void BlendPalettes(const PaletteFrame& frame, const PaletteFrame& next_frame, int bone_count, int vertex_count, float t, Skinning_Mode skinning, PoseBuffer& pose);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <AnimationPlayer.hpp>
+
+#include <cstddef>
+#include <unordered_map>
+
+#define DEFAULT_POSE_CACHE_STEP (1.0 / 120.0)	// Default time quantization (seconds) of the pose cache, half a frame at 60 Hz
+
+/// <summary>
+/// Per frame cache of evaluated poses, so instances playing the same clip at (nearly) the same time share one palette.
+///
+/// Players are looked up on the render thread before the frame is dispatched. The first player with a key owns the pose
+/// and is evaluated as usual, every later player with the same key shares it (see AnimationPlayer::SharePose) and is not evaluated.
+/// The pose is evaluated at the time of the owner, so the players sharing it are off by at most one quantization step.
+/// </summary>
+class PoseCache {
+public:
+	double time_step = DEFAULT_POSE_CACHE_STEP;		// Time quantization (seconds), 0 disables sharing
+
+	/// <summary>
+	/// Forgets the poses of the previous frame and resets the counters of the frame
+	/// </summary>
+	void BeginFrame();
+
+	/// <summary>
+	/// Looks up the pose of a player for this frame, the player becomes the owner of its key on a miss.
+	/// Players that blend several clips or are evaluated at a reduced LOD rate are neither hits nor misses, they always evaluate their own pose
+	/// </summary>
+	/// <param name="player">: the player, after its time was updated for this frame</param>
+	/// <param name="interpolation">: the interpolation between keyframes</param>
+	/// <param name="skinning">: the palette the player is evaluated into, only players with the same skinning mode share a pose</param>
+	/// <returns>The player whose pose the given player shares, nullptr if it has to evaluate its own</returns>
+	const AnimationPlayer* Lookup(const AnimationPlayer& player, Interpolation_Mode interpolation, Skinning_Mode skinning);
+
+	inline unsigned int GetFrameHits() const
+	{
+		return frame_hits;
+	}
+
+	inline unsigned int GetFrameMisses() const
+	{
+		return frame_misses;
+	}
+
+	inline unsigned long long GetTotalHits() const
+	{
+		return total_hits;
+	}
+
+	inline unsigned long long GetTotalMisses() const
+	{
+		return total_misses;
+	}
+
+private:
+	/// <summary>
+	/// Everything a single clip pose depends on
+	/// </summary>
+	struct Key {
+		const Mesh* mesh;				// Rig
+		const AnimationClip* clip;		// Clip, owned by the mesh
+		long long time;					// Animation time in multiples of time_step
+		Interpolation_Mode interpolation;	// Interpolation between keyframes
+		Skinning_Mode skinning;			// Palette the pose is evaluated into
+		bool baked;						// Baked palettes or sampled clip
+
+		inline bool operator==(const Key& other) const
+		{
+			return mesh == other.mesh && clip == other.clip && time == other.time && interpolation == other.interpolation && skinning == other.skinning && baked == other.baked;
+		}
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	std::unordered_map<Key, const AnimationPlayer*, KeyHash> owners;	// Player that evaluates the pose of each key this frame
+	unsigned int frame_hits = 0;			// Players sharing a pose this frame
+	unsigned int frame_misses = 0;			// Players owning a pose this frame
+	unsigned long long total_hits = 0;		// Hits since the cache was created
+	unsigned long long total_misses = 0;	// Misses since the cache was created
+};
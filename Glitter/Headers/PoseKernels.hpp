@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// Instruction sets used by the pose kernels, chosen at compile time (see BAMF_USE_AVX2 in CMakeLists.txt)
+#if defined(__AVX__)
+#define POSE_KERNELS_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSE_KERNELS_SSE
+#endif
+
+/// <summary>
+/// Scale, Rotation and Translation of a single joint
+/// </summary>
+struct SQT {
+	glm::vec3 scale = glm::vec3(1.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 translation = glm::vec3(0.0f);
+};
+
+/// <summary>
+/// Affine transform, stored as the upper three rows of a 4x4 matrix (the last row is always 0, 0, 0, 1).
+/// Rows are stored instead of columns, so every row fits a single SIMD register
+/// </summary>
+struct AffineTransform {
+	glm::vec4 rows[3] = { glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) };
+
+	/// <summary>
+	/// Converts a (column-major) glm matrix, the last row is dropped
+	/// </summary>
+	static AffineTransform FromMat4(const glm::mat4& matrix);
+
+	/// <summary>
+	/// Converts back to a (column-major) glm matrix
+	/// </summary>
+	glm::mat4 ToMat4() const;
+
+	inline glm::vec3 GetTranslation() const
+	{
+		return glm::vec3(rows[0].w, rows[1].w, rows[2].w);
+	}
+};
+
+/// <summary>
+/// Sampled joint transforms stored as a structure of arrays, the input of ComposeAffineTransforms.
+/// Cleared every frame, the arrays keep their capacity so sampling does not allocate
+/// </summary>
+struct SQTBatch {
+	std::vector<float> translation[3];					// Translation x, y, z
+	std::vector<float> rotation[4];						// Rotation quaternion x, y, z, w
+	std::vector<float> scale[3];						// Scale x, y, z
+	std::vector<int> joints;							// Target joint of each entry
+	int count = 0;										// Number of entries in use
+
+	inline void Clear()
+	{
+		count = 0;
+	}
+
+	inline void Add(int joint, const glm::vec3& t, const glm::quat& r, const glm::vec3& s)
+	{
+		if (count == static_cast<int>(joints.size()))
+			Grow();
+
+		translation[0][count] = t.x; translation[1][count] = t.y; translation[2][count] = t.z;
+		rotation[0][count] = r.x; rotation[1][count] = r.y; rotation[2][count] = r.z; rotation[3][count] = r.w;
+		scale[0][count] = s.x; scale[1][count] = s.y; scale[2][count] = s.z;
+		joints[count] = joint;
+		count++;
+	}
+
+private:
+	void Grow();
+};
+
+/// <summary>
+/// Converts every entry of the batch to an affine transform (translation * rotation * scale),
+/// written to transforms[batch.joints[i]]. Rotations are expected to be normalized
+/// </summary>
+/// <param name="batch">: the sampled joint transforms</param>
+/// <param name="transforms">: the local transforms of the skeleton</param>
+void ComposeAffineTransforms(const SQTBatch& batch, AffineTransform* transforms);
+
+/// <summary>
+/// Copies every entry of the batch to transforms[batch.joints[i]]
+/// </summary>
+/// <param name="batch">: the sampled joint transforms</param>
+/// <param name="transforms">: the local transforms of the skeleton</param>
+void CopySQTs(const SQTBatch& batch, SQT* transforms);
+
+/// <summary>
+/// Splits a transform into scale, rotation and translation. Shear is lost, a mirroring is kept as negative x scale.
+/// Only meant for load time, evaluation never decomposes matrices
+/// </summary>
+/// <param name="matrix">: the transform</param>
+SQT DecomposeTransform(const glm::mat4& matrix);
+
+/// <summary>
+/// Calculates result = a * b without matrices: the scale of a only scales the translation of b, the scales are multiplied per axis.
+/// Exact for uniform scales, a non-uniform scale above a rotated child loses the shear. result may be the same object as a or b
+/// </summary>
+void MultiplySQT(const SQT& a, const SQT& b, SQT& result);
+
+/// <summary>
+/// Calculates result = a * b. result may be the same object as a
+/// </summary>
+void MultiplyAffine(const AffineTransform& a, const AffineTransform& b, AffineTransform& result);
+
+/// <summary>
+/// Concatenates local transforms down the skeleton and builds the skinning palette in a single pass.
+/// Joints must be ordered so parents come before their children
+/// </summary>
+/// <param name="parents">: parent joint index of each joint, -1 for the root</param>
+/// <param name="bone_ids">: bone index of each joint, -1 if the joint is not a bone</param>
+/// <param name="local">: local transform of each joint</param>
+/// <param name="offsets">: offset (inverse bind) transform of each bone</param>
+/// <param name="root_inverse">: inverse of the root transform, applied to every palette entry</param>
+/// <param name="joint_count">: number of joints</param>
+/// <param name="global">: receives the global transform of each joint</param>
+/// <param name="palette">: receives root_inverse * global * offset for each bone</param>
+void ConcatenatePose(const int* parents, const int* bone_ids, const AffineTransform* local, const AffineTransform* offsets, const AffineTransform& root_inverse, int joint_count, AffineTransform* global, AffineTransform* palette);
+
+/// <summary>
+/// Concatenates local SQTs down the skeleton and builds the dual quaternion palette directly from the rotations and translations,
+/// without building matrices or decomposing them again. Scale is carried down separately and only moves the children, like the rigid DQ shader ignores it.
+/// Joints must be ordered so parents come before their children
+/// </summary>
+/// <param name="parents">: parent joint index of each joint, -1 for the root</param>
+/// <param name="bone_ids">: bone index of each joint, -1 if the joint is not a bone</param>
+/// <param name="local">: local transform of each joint</param>
+/// <param name="offsets">: offset (inverse bind) transform of each bone</param>
+/// <param name="root_inverse">: inverse of the root transform, applied to every palette entry</param>
+/// <param name="joint_count">: number of joints</param>
+/// <param name="global">: receives the global transform of each joint</param>
+/// <param name="dual_quats">: receives the unit dual quaternion of root_inverse * global * offset for each bone</param>
+/// <param name="scales">: receives the scale of each bone as matrix, applied before the dual quaternion (scale-aware DQ skinning). May be nullptr</param>
+void ConcatenateDualQuatPose(const int* parents, const int* bone_ids, const SQT* local, const SQT* offsets, const SQT& root_inverse, int joint_count, SQT* global, glm::mat4x2* dual_quats, glm::mat4* scales);
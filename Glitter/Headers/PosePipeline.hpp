@@ -0,0 +1,118 @@
+#pragma once
+
+#include <AnimationClip.hpp>
+#include <PoseBuffer.hpp>
+#include <cubic.hpp>
+
+#include <algorithm>
+
+// Policies of the pose pipeline (see AnimationClip::Evaluate and Mesh::EvaluatePipeline).
+// Both are chosen at compile time, so every combination inlines into its own loops without branching on the mode per joint
+
+/// <summary>
+/// Sampler policy: holds the keyframe at the start of the segment, without interpolation
+/// </summary>
+struct StepSampler {
+	template <typename T>
+	static inline void Sample(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, double time, int* cursor, T& value)
+	{
+		float t;
+		clip.GetKey(type, track, clip.FindSegment(type, track, time, cursor, &t), value);
+	}
+};
+
+/// <summary>
+/// Sampler policy: linear interpolation for translation and scale, slerp for rotations
+/// </summary>
+struct LinearSampler {
+	template <typename T>
+	static inline void Sample(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, double time, int* cursor, T& value)
+	{
+		float t;
+		const int key = clip.FindSegment(type, track, time, cursor, &t);
+
+		T next_value;
+		clip.GetKey(type, track, key, value);
+		clip.GetKey(type, track, std::min(key + 1, track.key_count - 1), next_value);
+		value = AnimationClip::InterpolateKeys(value, next_value, t);
+	}
+};
+
+/// <summary>
+/// Sampler policy: Catmull-Rom for translation and scale, SQUAD for rotations. Uses the precomputed segments if the track has them
+/// </summary>
+struct CubicSampler {
+	static inline void Sample(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, double time, int* cursor, glm::vec3& value)
+	{
+		float t;
+		const int key = clip.FindSegment(type, track, time, cursor, &t);
+		const int last_key = track.key_count - 1;
+
+		// Precomputed polynomial of the segment
+		if (track.first_segment >= 0)
+		{
+			value = cubicEvaluate(clip.GetCubicSegment(track, key), t);
+			return;
+		}
+
+		// Compressed tracks build it from the keyframes around the segment
+		glm::vec3 previous_value, next_value, next_next_value;
+		clip.GetKey(type, track, std::max(key - 1, 0), previous_value);
+		clip.GetKey(type, track, key, value);
+		clip.GetKey(type, track, std::min(key + 1, last_key), next_value);
+		clip.GetKey(type, track, std::min(key + 2, last_key), next_next_value);
+		value = cubicInterpolate(previous_value, value, next_value, next_next_value, t);
+	}
+
+	static inline void Sample(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, double time, int* cursor, glm::quat& value)
+	{
+		float t;
+		const int key = clip.FindSegment(type, track, time, cursor, &t);
+		const int last_key = track.key_count - 1;
+		const int next_key = std::min(key + 1, last_key);
+
+		glm::quat next_value;
+		clip.GetKey(type, track, key, value);
+		clip.GetKey(type, track, next_key, next_value);
+
+		// Precomputed control rotations
+		if (track.first_segment >= 0)
+		{
+			value = AnimationClip::InterpolateKeys(value, next_value, clip.GetSquadControl(track, key), clip.GetSquadControl(track, next_key), t);
+			return;
+		}
+
+		// Compressed tracks calculate them from the keyframes around the segment
+		glm::quat previous_value, next_next_value;
+		clip.GetKey(type, track, std::max(key - 1, 0), previous_value);
+		clip.GetKey(type, track, std::min(key + 2, last_key), next_next_value);
+		value = AnimationClip::InterpolateKeys(value, next_value, AnimationClip::ComputeSquadControl(previous_value, value, next_value), AnimationClip::ComputeSquadControl(value, next_value, next_next_value), t);
+	}
+};
+
+/// <summary>
+/// Output policy: matrix palette (PoseBuffer::palette), for bone_shader.vert
+/// </summary>
+struct MatrixOutput {
+	static const Skinning_Mode skinning = SKINNING_LINEAR_BLEND;
+	static const bool dual_quat = false;
+	static const bool scale = false;
+};
+
+/// <summary>
+/// Output policy: rigid dual quaternion palette (PoseBuffer::dual_quats), for bone_dq_no_scale_shader.vert
+/// </summary>
+struct DualQuatOutput {
+	static const Skinning_Mode skinning = SKINNING_DUAL_QUAT;
+	static const bool dual_quat = true;
+	static const bool scale = false;
+};
+
+/// <summary>
+/// Output policy: dual quaternion palette plus the scale of every bone (PoseBuffer::scale_transforms), for bone_dq_scale_shader.vert
+/// </summary>
+struct ScaledDualQuatOutput {
+	static const Skinning_Mode skinning = SKINNING_SCALED_DUAL_QUAT;
+	static const bool dual_quat = true;
+	static const bool scale = true;
+};
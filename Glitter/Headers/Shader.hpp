@@ -41,8 +41,8 @@ public:
     void setFloat(const std::string& name, float value) const;
     void setMat4(const std::string& name, glm::mat4 mat) const;
     void setVec3(const std::string& name, glm::vec3 vec) const;
-    void setMat4Vector(const std::string& name, std::vector<glm::mat4> mat_vec) const;
-    void setMat4x2Vector(const std::string& name, std::vector<glm::mat4x2> mat_vec) const;
+    void setMat4Vector(const std::string& name, const std::vector<glm::mat4>& mat_vec) const;
+    void setMat4x2Vector(const std::string& name, const std::vector<glm::mat4x2>& mat_vec) const;
 
     /// <summary>
     /// Register a shader file and associated shader type to the shader program
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <PoseKernels.hpp>
+#include <assimp/scene.h>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Flattened copy of the node tree (aiNode) of an imported scene, built once at load time.
+///
+/// Joints are stored in depth-first order, meaning a parent always comes before its children.
+/// Local to global transformation is therefore a single linear loop over the joints.
+/// </summary>
+class Skeleton
+{
+public:
+	std::vector<int> parents;							// Parent joint index for each joint, -1 for the root
+	std::vector<AffineTransform> local_bind;			// Local bind transform of each joint, relative to its parent
+	std::vector<glm::vec3> bind_translations;			// Translation of the local bind transform of each joint
+	std::vector<glm::quat> bind_rotations;				// Rotation of the local bind transform of each joint
+	std::vector<glm::vec3> bind_scales;					// Scale of the local bind transform of each joint
+	std::vector<std::string> names;						// Node name of each joint (only used at load time)
+	std::vector<int> bone_ids;							// Index in the bone list of the Mesh for each joint, -1 if the joint is not a bone
+
+	/// <summary>
+	/// Flattens the node tree starting at the root node
+	/// </summary>
+	/// <param name="root">: the root node of the scene</param>
+	void Build(const aiNode* root);
+
+	/// <summary>
+	/// Looks up a joint by node name. Slow, should not be used during evaluation
+	/// </summary>
+	/// <param name="name">: the node name</param>
+	/// <returns>The joint index, or -1 if no joint exists with that name</returns>
+	int FindJoint(const std::string& name) const;
+
+	/// <summary>
+	/// Builds a per joint mask that is 1 for a joint and all its descendants, and 0 elsewhere (e.g. the upper body from the spine)
+	/// </summary>
+	/// <param name="root">: the root joint of the masked subtree</param>
+	/// <param name="mask">: receives the weight of every joint</param>
+	void BuildSubtreeMask(int root, std::vector<float>& mask) const;
+
+	/// <summary>
+	/// Removes all joints that are neither a bone nor an ancestor of a bone (mesh holders, helper and pivot nodes, ...),
+	/// so evaluation only visits joints that contribute to the palette or the skeleton rendering.
+	/// Has to be called after bone_ids are linked, and before joint indices are stored anywhere else
+	/// </summary>
+	/// <returns>The number of removed joints</returns>
+	int Prune();
+
+	/// <summary>
+	/// Returns the number of joints in the skeleton
+	/// </summary>
+	inline int GetJointCount() const
+	{
+		return static_cast<int>(parents.size());
+	}
+
+private:
+	/// <summary>
+	/// Adds a node and (recursively) its children to the joint arrays
+	/// </summary>
+	/// <param name="node">: the node to add</param>
+	/// <param name="parent">: the joint index of the parent node</param>
+	void AddJoint(const aiNode* node, int parent);
+};
@@ -1,8 +1,10 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
 
 #define MAXIMUM_BONES 4 
+#define MAXIMUM_PACKED_BONE_ID 65535				// Largest bone ID a PackedVertex can store
 
 /// <summary>
 /// Struct containing Vertex information
@@ -18,15 +20,34 @@ struct Vertex {
 	float weights[MAXIMUM_BONES] = { 0.0f };	// Initialized to zeros
 };
 
+/// <summary>
+/// Compact GPU layout of a Vertex, 40 instead of 92 bytes. Built at import by PackVertex, only the vertex buffer uses it.
+/// The attribute setup in Mesh lets GL decode it, so the shaders read the same vec3 / vec2 / vec4 attributes as before.
+/// The bitangent is not stored, no shader reads it. It can be rebuilt as cross(normal, tangent.xyz) * tangent.w
+/// </summary>
+struct PackedVertex {
+	glm::vec3 position;							// Full precision, large meshes need it
+	uint32_t normal;							// snorm 10:10:10:2 (GL_INT_2_10_10_10_REV)
+	uint32_t tangent;							// snorm 10:10:10:2, w is the handedness of the bitangent (+1 or -1)
+	uint32_t texCoords;							// Two half floats, exact to 1/2048 within [0, 1]
+	uint16_t boneIDs[MAXIMUM_BONES];			// Bone indices, up to 65536 bones (MAXIMUM_PACKED_BONE_ID)
+	uint16_t weights[MAXIMUM_BONES];			// unorm16, quantized so they keep the sum of the weights (exactly 1 after import)
+};
+
+/// <summary>
+/// Quantizes a vertex into the GPU layout. Influences with a bone ID outside [0, MAXIMUM_PACKED_BONE_ID] are dropped
+/// </summary>
+/// <param name="vertex">: the imported vertex</param>
+/// <param name="dropped_influences">: optional counter, incremented for every weighted influence that was dropped</param>
+PackedVertex PackVertex(const Vertex& vertex, int* dropped_influences = nullptr);
+
 /// <summary>
 /// Struct containing Bone information
 /// </summary>
 struct BoneInfo
 {
 	int id;										// Bone ID index
-	glm::mat4 offsetMatrix;						// Offset matrix for bone space
-	glm::mat4 bone_transform = glm::mat4(0.0f);	// Final bone tranformation matrix
-	glm::mat4x2 dual_quat = glm::mat4x2(0.0f);	// Final bone dual quaternion
+	glm::mat4 offsetMatrix;						// Offset matrix for bone space (per frame results live in PoseBuffer)
 };
 
 /// <summary>
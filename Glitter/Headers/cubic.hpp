@@ -4,23 +4,36 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-glm::vec3 cubicInterpolate(
+// Catmull-Rom polynomial a * t^3 + b * t^2 + c * t + d from p1 (t = 0) to p2 (t = 1), stored as { a, b, c, d }
+inline void cubicCoefficients(
     const glm::vec3& p0, const glm::vec3& p1,
     const glm::vec3& p2, const glm::vec3& p3,
-    float t)
+    glm::vec3 coefficients[4])
 {
-    float t2 = t * t;
-    float t3 = t2 * t;
+    coefficients[0] = (3.0f * p1 - 3.0f * p2 + p3 - p0) / 2.0f;
+    coefficients[1] = (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) / 2.0f;
+    coefficients[2] = (p2 - p0) / 2.0f;
+    coefficients[3] = p1;
+}
 
-    glm::vec3 a = (3.0f * p1 - 3.0f * p2 + p3 - p0) / 2.0f;
-    glm::vec3 b = (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) / 2.0f;
-    glm::vec3 c = (p2 - p0) / 2.0f;
-    glm::vec3 d = p1;
+// Evaluates the polynomial of cubicCoefficients using Horner's scheme
+inline glm::vec3 cubicEvaluate(const glm::vec3 coefficients[4], float t)
+{
+    return ((coefficients[0] * t + coefficients[1]) * t + coefficients[2]) * t + coefficients[3];
+}
+
+inline glm::vec3 cubicInterpolate(
+    const glm::vec3& p0, const glm::vec3& p1,
+    const glm::vec3& p2, const glm::vec3& p3,
+    float t)
+{
+    glm::vec3 coefficients[4];
+    cubicCoefficients(p0, p1, p2, p3, coefficients);
 
-    return a * t3 + b * t2 + c * t + d;
+    return cubicEvaluate(coefficients, t);
 }
 
-glm::quat cubicInterpolate(
+inline glm::quat cubicInterpolate(
     const glm::quat& q0, const glm::quat& q1,
     const glm::quat& q2, const glm::quat& q3,
     float t)
@@ -7,19 +7,24 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoords;
 layout(location = 3) in vec3 tangent;
-layout(location = 4) in vec3 biTangent;
-layout(location = 5) in ivec4 boneIDs;      // Size of 4 is in accordance with the 4 bone per vertex convention
+layout(location = 5) in uvec4 boneIDs;      // Size of 4 is in accordance with the 4 bone per vertex convention
 layout(location = 6) in vec4 boneWeights;
 
-const int MAX_BONES = 120;                   // We need a maximum number, and 120 should be safe for the vast majority of rigs
-
 out vec3 Normal;
 out vec3 WorldPos;
 out vec2 TexCoords;
 out vec3 TestColor;
 
-uniform mat4x2 boneTransforms[MAX_BONES];   // Each bone transform is represented by two quaternions (mat4x2)
-uniform mat4 scaleTransforms[MAX_BONES];    // Scaling for each bone
+// Each bone transform is represented by two quaternions (mat4x2), std430 packs them like glm (32 bytes)
+layout(std430, binding = 0) readonly buffer BonePalette {
+    mat4x2 boneTransforms[];
+};
+
+// Scaling for each bone, applied before the dual quaternion
+layout(std430, binding = 1) readonly buffer BoneScales {
+    mat4 scaleTransforms[];
+};
+
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 uniform mat4 projectionMatrix;
@@ -81,8 +86,7 @@ void main()
     qt = qt * finalScale;
 
     // Calculate final vertex position
-    new_position = vec4(qt * new_position, 1.0);
-//    new_position = vec4(qt * vec4(position, 1.0), 1.0);
+    new_position = vec4(qt * vec4(position, 1.0), 1.0);
 
     // Calculate final normal direction
     vec3 new_normal = qt * vec4(normal, 0.0);
@@ -7,18 +7,20 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoords;
 layout(location = 3) in vec3 tangent;
-layout(location = 4) in vec3 biTangent;
-layout(location = 5) in ivec4 boneIDs;      // Size of 4 is in accordance with the 4 bone per vertex convention
+layout(location = 5) in uvec4 boneIDs;      // Size of 4 is in accordance with the 4 bone per vertex convention
 layout(location = 6) in vec4 boneWeights;
 
-const int MAX_BONES = 120;                   // We need a maximum number, and 120 should be safe for the vast majority of rigs
-
 out vec3 Normal;
 out vec3 Tangent;
 out vec3 WorldPos;
 out vec2 TexCoords;
 
-uniform mat4 boneTransforms[MAX_BONES];
+// Palette of the instance, a range of the palette ring bound by Mesh::UploadPose, so there is no maximum number of bones.
+// Every bone is the three rows of its affine transform (AffineTransform), each column of a mat3x4 holds one row
+layout(std430, binding = 0) readonly buffer BonePalette {
+    mat3x4 boneTransforms[];
+};
+
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 uniform mat4 projectionMatrix;
@@ -28,20 +30,20 @@ void main()
     vec4 new_position;
 
     // Loop between 4 bones for position
-    mat4 finalBoneTransform = boneTransforms[boneIDs.x] * boneWeights.x;
+    mat3x4 finalBoneTransform = boneTransforms[boneIDs.x] * boneWeights.x;
     finalBoneTransform += boneTransforms[boneIDs.y] * boneWeights.y;
     finalBoneTransform += boneTransforms[boneIDs.z] * boneWeights.z;
     finalBoneTransform += boneTransforms[boneIDs.w] * boneWeights.w;
 
-    // Calculate final vertex position
-    new_position = finalBoneTransform * vec4(position, 1.0);
+    // Calculate final vertex position, multiplying from the left dots the vector with every row
+    new_position = vec4(vec4(position, 1.0) * finalBoneTransform, 1.0);
 
     // Calculate final normal direction
-    vec4 new_normal = finalBoneTransform * vec4(normal, 0.0);
+    vec4 new_normal = vec4(vec4(normal, 0.0) * finalBoneTransform, 0.0);
 
     // TODO: Tangent and Bitangent will also be affected by finalBoneTransform!
 
-    vec4 new_tangent = finalBoneTransform * vec4(tangent, 0.0);
+    vec4 new_tangent = vec4(vec4(tangent, 0.0) * finalBoneTransform, 0.0);
 
     gl_Position = projectionMatrix * viewMatrix * modelMatrix * new_position;
     Normal = mat3(transpose(inverse(modelMatrix))) * new_normal.xyz;    // Presumably correct
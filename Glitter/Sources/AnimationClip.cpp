@@ -1,18 +1,878 @@
 #include <AnimationClip.hpp>
+#include <PosePipeline.hpp>
+#include <Skeleton.hpp>
+#include <cubic.hpp>
 
-AnimationClip::AnimationClip(std::string nameID, int n_bones, int max_frames, double duration, double ticks_per_second, std::map<std::string, AnimationPose> poseSamples)
+#include <algorithm>
+#include <cmath>
+
+// Compares two translation or scale keyframes
+static bool KeysEqual(const glm::vec3& key, const glm::vec3& other_key)
+{
+	return glm::length(key - other_key) <= TRACK_TOLERANCE * glm::max(1.0f, glm::length(other_key));
+}
+
+// Compares two rotation keyframes, q and -q are the same rotation
+static bool KeysEqual(const glm::quat& key, const glm::quat& other_key)
+{
+	return glm::abs(glm::dot(key, other_key)) >= glm::cos(TRACK_ROTATION_TOLERANCE * 0.5f);
+}
+
+// Distance between two keyframes, used as resampling error
+static float KeyError(const glm::vec3& key, const glm::vec3& other_key)
+{
+	return glm::length(key - other_key);
+}
+
+// Angle between two rotation keyframes, used as resampling error
+static float KeyError(const glm::quat& key, const glm::quat& other_key)
+{
+	return 2.0f * std::acos(glm::min(glm::abs(glm::dot(key, other_key)), 1.0f));
+}
+
+// Logarithm of a unit quaternion, the rotation axis scaled by half the angle
+static glm::vec3 QuatLog(const glm::quat& q)
+{
+	const glm::vec3 axis(q.x, q.y, q.z);
+	const float length = glm::length(axis);
+
+	if (length < 1e-6f)
+		return glm::vec3(0.0f);
+
+	return axis * (std::atan2(length, q.w) / length);
+}
+
+// Exponential of a pure quaternion, the inverse of QuatLog
+static glm::quat QuatExp(const glm::vec3& v)
+{
+	const float angle = glm::length(v);
+
+	if (angle < 1e-6f)
+		return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+	const glm::vec3 axis = v * (std::sin(angle) / angle);
+	return glm::quat(std::cos(angle), axis.x, axis.y, axis.z);
+}
+
+// Finds the segment of a uniformly sampled track, without any search
+static inline int GetUniformSegment(float rate, int key_count, double time, float* factor)
+{
+	const float frame = glm::max(static_cast<float>(time) * rate, 0.0f);
+	const int index = glm::max(glm::min(static_cast<int>(frame), key_count - 2), 0);
+
+	*factor = glm::clamp(frame - static_cast<float>(index), 0.0f, 1.0f);
+
+	return index;
+}
+
+// Resamples a single track to key_count keyframes at the given rate, returns the largest error at the original keyframes
+template <typename T>
+static float ResampleTrack(const std::vector<float>& times, const std::vector<T>& keys, AnimationTrack& track, float rate, int key_count, std::vector<T>& new_keys)
+{
+	const AnimationTrack source = track;
+	track.first_key = static_cast<int>(new_keys.size());
+
+	if (source.key_count == 0)
+		return 0.0f;
+
+	track.key_count = key_count;
+
+	// Sample the original keyframes with linear interpolation
+	int cursor = 0;
+	for (int k = 0; k < key_count; k++)
+	{
+		const double time = k / static_cast<double>(rate);
+		const int index = AnimationClip::FindKeyframe(times, source, time, &cursor);
+		const int key = source.first_key + index;
+		const int next_key = source.first_key + std::min(index + 1, source.key_count - 1);
+
+		float t = AnimationClip::GetInterpolationFactor(times[key], times[next_key], time);
+		new_keys.push_back(AnimationClip::InterpolateKeys(keys[key], keys[next_key], t));
+	}
+
+	// Both tracks are piecewise linear, so the largest error is found at the original keyframes
+	float max_error = 0.0f;
+	for (int k = 0; k < source.key_count; k++)
+	{
+		float t;
+		const int index = track.first_key + GetUniformSegment(rate, key_count, times[source.first_key + k], &t);
+		const T value = AnimationClip::InterpolateKeys(new_keys[index], new_keys[index + 1], t);
+
+		max_error = glm::max(max_error, KeyError(value, keys[source.first_key + k]));
+	}
+
+	return max_error;
+}
+
+// Copies a track to the new keyframe arrays, keeping only a single keyframe (or none) if it never changes
+template <typename T>
+static void CompactTrack(const std::vector<float>& times, const std::vector<T>& keys, AnimationTrack& track, const T& identity, const T* bind_value, std::vector<float>& new_times, std::vector<T>& new_keys)
+{
+	const int first_key = track.first_key;
+	track.first_key = static_cast<int>(new_keys.size());
+
+	if (track.key_count == 0)
+		return;
+
+	bool constant = true;
+	for (int k = 1; k < track.key_count && constant; k++)
+		constant = KeysEqual(keys[first_key + k], keys[first_key]);
+
+	if (!constant)
+	{
+		if (!times.empty())
+			new_times.insert(new_times.end(), times.begin() + first_key, times.begin() + first_key + track.key_count);
+		new_keys.insert(new_keys.end(), keys.begin() + first_key, keys.begin() + first_key + track.key_count);
+		track.mode = TRACK_ANIMATED;
+		return;
+	}
+
+	if (bind_value && KeysEqual(keys[first_key], *bind_value))
+	{
+		track.key_count = 0;
+		track.mode = TRACK_BIND_POSE;
+	}
+	else if (KeysEqual(keys[first_key], identity))
+	{
+		track.key_count = 0;
+		track.mode = TRACK_IDENTITY;
+	}
+	else
+	{
+		if (!times.empty())
+			new_times.push_back(times[first_key]);
+		new_keys.push_back(keys[first_key]);
+		track.key_count = 1;
+		track.mode = TRACK_CONSTANT;
+	}
+}
+
+#define SMALLEST_THREE_RANGE 0.70710678f	// The three smallest components of a unit quaternion are within [-1/sqrt(2), 1/sqrt(2)]
+
+// Maps a value in [0, 1] to an integer of the given number of bits
+static inline uint32_t QuantizeUnit(float value, int bits)
+{
+	const float max_value = static_cast<float>((1u << bits) - 1);
+	return static_cast<uint32_t>(glm::clamp(value, 0.0f, 1.0f) * max_value + 0.5f);
+}
+
+static inline float DequantizeUnit(uint32_t value, int bits)
+{
+	return static_cast<float>(value) / static_cast<float>((1u << bits) - 1);
+}
+
+// Quantizes a translation or scale keyframe relative to the range of its track
+static inline void QuantizeVector(const glm::vec3& value, const AnimationTrack& track, uint32_t quantized[3])
+{
+	for (int i = 0; i < 3; i++)
+		quantized[i] = track.range_extent[i] > 0.0f ? QuantizeUnit((value[i] - track.range_min[i]) / track.range_extent[i], track.bit_rate) : 0;
+}
+
+static inline glm::vec3 DequantizeVector(const uint32_t quantized[3], const AnimationTrack& track)
+{
+	return track.range_min + track.range_extent * glm::vec3(DequantizeUnit(quantized[0], track.bit_rate), DequantizeUnit(quantized[1], track.bit_rate), DequantizeUnit(quantized[2], track.bit_rate));
+}
+
+// Quantizes a rotation keyframe as its smallest three components, quantized[0] is the index of the dropped largest component
+static inline void QuantizeRotation(const glm::quat& value, int bits, uint32_t quantized[4])
+{
+	const glm::quat rotation = glm::normalize(value);
+	const float components[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+	{
+		if (glm::abs(components[i]) > glm::abs(components[largest]))
+			largest = i;
+	}
+
+	// q and -q are the same rotation, flip so the dropped component is positive
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	quantized[0] = static_cast<uint32_t>(largest);
+	for (int i = 0, j = 1; i < 4; i++)
+	{
+		if (i != largest)
+			quantized[j++] = QuantizeUnit((sign * components[i] + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE), bits);
+	}
+}
+
+static inline glm::quat DequantizeRotation(const uint32_t quantized[4], int bits)
+{
+	const int largest = static_cast<int>(quantized[0]);
+	float components[4];
+	float length_squared = 0.0f;
+
+	for (int i = 0, j = 1; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+
+		components[i] = DequantizeUnit(quantized[j++], bits) * 2.0f * SMALLEST_THREE_RANGE - SMALLEST_THREE_RANGE;
+		length_squared += components[i] * components[i];
+	}
+
+	// The dropped component follows from the unit length
+	components[largest] = std::sqrt(glm::max(1.0f - length_squared, 0.0f));
+
+	return glm::normalize(glm::quat(components[3], components[0], components[1], components[2]));
+}
+
+// Appends bits to the compressed stream, least significant bit first
+static void WriteBits(std::vector<uint8_t>& stream, size_t& bit_position, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, bit_position++)
+	{
+		if ((bit_position >> 3) >= stream.size())
+			stream.push_back(0);
+
+		if ((value >> i) & 1u)
+			stream[bit_position >> 3] |= static_cast<uint8_t>(1u << (bit_position & 7));
+	}
+}
+
+// Reads up to 16 bits from the compressed stream, which is padded so the 3 byte window never reads past its end
+static inline uint32_t ReadBits(const uint8_t* stream, size_t bit_position, int count)
+{
+	const uint8_t* bytes = stream + (bit_position >> 3);
+	const uint32_t window = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+
+	return (window >> (bit_position & 7)) & ((1u << count) - 1u);
+}
+
+// Bone space error of a translation keyframe
+static inline float TranslationError(const glm::vec3& key, const glm::vec3& other_key, float)
+{
+	return glm::length(key - other_key);
+}
+
+// Bone space error of a scale keyframe, the distance a point on an axis at shell_distance from the joint moves
+static inline float ScaleError(const glm::vec3& key, const glm::vec3& other_key, float shell_distance)
+{
+	const glm::vec3 difference = glm::abs(key - other_key);
+	return shell_distance * glm::max(difference.x, glm::max(difference.y, difference.z));
+}
+
+// Bone space error of a rotation keyframe, the distance points on the axes at shell_distance from the joint move
+static inline float RotationError(const glm::quat& key, const glm::quat& other_key, float shell_distance)
+{
+	float error = 0.0f;
+	for (int i = 0; i < 3; i++)
+	{
+		glm::vec3 point(0.0f);
+		point[i] = shell_distance;
+		error = glm::max(error, glm::length(key * point - other_key * point));
+	}
+
+	return error;
+}
+
+// Quantizes a translation or scale track at the smallest bit rate within tolerance and appends it to the stream, returns its error
+static float CompressVectorTrack(const std::vector<glm::vec3>& keys, AnimationTrack& track, float (*key_error)(const glm::vec3&, const glm::vec3&, float), float shell_distance, float tolerance, std::vector<uint8_t>& stream, size_t& bit_position)
+{
+	const glm::vec3* track_keys = keys.data() + track.first_key;
+
+	glm::vec3 range_max = track_keys[0];
+	track.range_min = track_keys[0];
+	for (int k = 1; k < track.key_count; k++)
+	{
+		track.range_min = glm::min(track.range_min, track_keys[k]);
+		range_max = glm::max(range_max, track_keys[k]);
+	}
+	track.range_extent = range_max - track.range_min;
+
+	uint32_t quantized[3];
+	float error;
+	for (track.bit_rate = COMPRESSION_MIN_BITS; ; track.bit_rate++)
+	{
+		error = 0.0f;
+		for (int k = 0; k < track.key_count; k++)
+		{
+			QuantizeVector(track_keys[k], track, quantized);
+			error = glm::max(error, key_error(DequantizeVector(quantized, track), track_keys[k], shell_distance));
+		}
+
+		if (error <= tolerance || track.bit_rate == COMPRESSION_MAX_BITS)
+			break;
+	}
+
+	track.bit_offset = static_cast<int>(bit_position);
+	for (int k = 0; k < track.key_count; k++)
+	{
+		QuantizeVector(track_keys[k], track, quantized);
+		for (int i = 0; i < 3; i++)
+			WriteBits(stream, bit_position, quantized[i], track.bit_rate);
+	}
+
+	return error;
+}
+
+// Quantizes a rotation track at the smallest bit rate within tolerance and appends it to the stream, returns its error
+static float CompressRotationTrack(const std::vector<glm::quat>& keys, AnimationTrack& track, float shell_distance, float tolerance, std::vector<uint8_t>& stream, size_t& bit_position)
+{
+	const glm::quat* track_keys = keys.data() + track.first_key;
+
+	uint32_t quantized[4];
+	float error;
+	for (track.bit_rate = COMPRESSION_MIN_BITS; ; track.bit_rate++)
+	{
+		error = 0.0f;
+		for (int k = 0; k < track.key_count; k++)
+		{
+			QuantizeRotation(track_keys[k], track.bit_rate, quantized);
+			error = glm::max(error, RotationError(DequantizeRotation(quantized, track.bit_rate), track_keys[k], shell_distance));
+		}
+
+		if (error <= tolerance || track.bit_rate == COMPRESSION_MAX_BITS)
+			break;
+	}
+
+	track.bit_offset = static_cast<int>(bit_position);
+	for (int k = 0; k < track.key_count; k++)
+	{
+		QuantizeRotation(track_keys[k], track.bit_rate, quantized);
+		WriteBits(stream, bit_position, quantized[0], 2);
+		for (int i = 1; i < 4; i++)
+			WriteBits(stream, bit_position, quantized[i], track.bit_rate);
+	}
+
+	return error;
+}
+
+AnimationClip::AnimationClip(std::string nameID, int n_bones, int max_frames, double duration, double ticks_per_second)
 {
 	this->nameID = nameID;
 	this->n_bones = n_bones;
 	this->max_frames = max_frames;
 	this->duration = duration;
 	this->ticks_per_second = ticks_per_second;
-	this->poseSamples = poseSamples;
 }
 
-glm::mat4 AnimationClip::Evaluate(int frame)
+int AnimationClip::AddChannel(const std::string& bone_name)
 {
-	return glm::mat4(1.0f);
+	// Only the first channel of a bone is used
+	if (channel_map.find(bone_name) != channel_map.end())
+		return -1;
+
+	int channel = static_cast<int>(channels.size());
+
+	AnimationPose new_pose;
+	new_pose.tracks[TRACK_TRANSLATION].first_key = static_cast<int>(translation_keys.size());
+	new_pose.tracks[TRACK_ROTATION].first_key = static_cast<int>(rotation_keys.size());
+	new_pose.tracks[TRACK_SCALE].first_key = static_cast<int>(scale_keys.size());
+
+	channels.push_back(new_pose);
+	channel_map.insert({ bone_name, channel });
+
+	// Unbound until a skeleton is known
+	channel_joints.push_back(-1);
+	channel_defaults.push_back(SQT());
+
+	return channel;
+}
+
+void AnimationClip::AddTranslationKey(int channel, float time, const glm::vec3& translation)
+{
+	translation_times.push_back(time);
+	translation_keys.push_back(translation);
+	channels[channel].tracks[TRACK_TRANSLATION].key_count++;
+	channels[channel].tracks[TRACK_TRANSLATION].mode = TRACK_ANIMATED;
+}
+
+void AnimationClip::AddRotationKey(int channel, float time, const glm::quat& rotation)
+{
+	rotation_times.push_back(time);
+	rotation_keys.push_back(rotation);
+	channels[channel].tracks[TRACK_ROTATION].key_count++;
+	channels[channel].tracks[TRACK_ROTATION].mode = TRACK_ANIMATED;
+}
+
+void AnimationClip::AddScaleKey(int channel, float time, const glm::vec3& scale)
+{
+	scale_times.push_back(time);
+	scale_keys.push_back(scale);
+	channels[channel].tracks[TRACK_SCALE].key_count++;
+	channels[channel].tracks[TRACK_SCALE].mode = TRACK_ANIMATED;
+}
+
+const std::vector<float>& AnimationClip::GetTrackTimes(Track_Type type) const
+{
+	switch (type)
+	{
+	case TRACK_TRANSLATION:
+		return translation_times;
+	case TRACK_ROTATION:
+		return rotation_times;
+	default:
+		return scale_times;
+	}
+}
+
+void AnimationClip::BindChannels(const Skeleton& skeleton)
+{
+	for (auto channel_it = channel_map.begin(); channel_it != channel_map.end(); channel_it++)
+		channel_joints[channel_it->second] = skeleton.FindJoint(channel_it->first);
+}
+
+int AnimationClip::EliminateStaticTracks(const Skeleton& skeleton)
+{
+	const int old_key_count = static_cast<int>(translation_keys.size() + rotation_keys.size() + scale_keys.size());
+	const SQT identity;
+
+	std::vector<float> new_translation_times, new_rotation_times, new_scale_times;
+	std::vector<glm::vec3> new_translation_keys, new_scale_keys;
+	std::vector<glm::quat> new_rotation_keys;
+
+	for (size_t channel = 0; channel < channels.size(); channel++)
+	{
+		AnimationPose& pose = channels[channel];
+		const int joint = channel_joints[channel];
+
+		// Channels of nodes outside the (pruned) skeleton are never evaluated, their keyframes are dropped
+		if (joint < 0)
+		{
+			for (int type = 0; type < TRACK_COUNT; type++)
+			{
+				pose.tracks[type].key_count = 0;
+				pose.tracks[type].mode = TRACK_IDENTITY;
+			}
+			pose.tracks[TRACK_TRANSLATION].first_key = static_cast<int>(new_translation_keys.size());
+			pose.tracks[TRACK_ROTATION].first_key = static_cast<int>(new_rotation_keys.size());
+			pose.tracks[TRACK_SCALE].first_key = static_cast<int>(new_scale_keys.size());
+			pose.bind_pose = false;
+			channel_defaults[channel] = identity;
+			continue;
+		}
+
+		CompactTrack(translation_times, translation_keys, pose.tracks[TRACK_TRANSLATION], identity.translation, &skeleton.bind_translations[joint], new_translation_times, new_translation_keys);
+		CompactTrack(rotation_times, rotation_keys, pose.tracks[TRACK_ROTATION], identity.rotation, &skeleton.bind_rotations[joint], new_rotation_times, new_rotation_keys);
+		CompactTrack(scale_times, scale_keys, pose.tracks[TRACK_SCALE], identity.scale, &skeleton.bind_scales[joint], new_scale_times, new_scale_keys);
+
+		pose.bind_pose = pose.tracks[TRACK_TRANSLATION].mode == TRACK_BIND_POSE
+			&& pose.tracks[TRACK_ROTATION].mode == TRACK_BIND_POSE
+			&& pose.tracks[TRACK_SCALE].mode == TRACK_BIND_POSE;
+
+		// Sampling returns these for tracks without keyframes
+		SQT& defaults = channel_defaults[channel];
+		defaults.translation = pose.tracks[TRACK_TRANSLATION].mode == TRACK_BIND_POSE ? skeleton.bind_translations[joint] : identity.translation;
+		defaults.rotation = pose.tracks[TRACK_ROTATION].mode == TRACK_BIND_POSE ? skeleton.bind_rotations[joint] : identity.rotation;
+		defaults.scale = pose.tracks[TRACK_SCALE].mode == TRACK_BIND_POSE ? skeleton.bind_scales[joint] : identity.scale;
+	}
+
+	translation_times.swap(new_translation_times);
+	translation_keys.swap(new_translation_keys);
+	rotation_times.swap(new_rotation_times);
+	rotation_keys.swap(new_rotation_keys);
+	scale_times.swap(new_scale_times);
+	scale_keys.swap(new_scale_keys);
+
+	return old_key_count - static_cast<int>(translation_keys.size() + rotation_keys.size() + scale_keys.size());
+}
+
+bool AnimationClip::Resample(float rate, float tolerance, float rotation_tolerance, float* max_error, float* max_rotation_error)
+{
+	if (rate <= 0.0f)
+		return false;
+
+	// Keyframes from 0 up to (and including) the end of the clip
+	const int key_count = glm::max(static_cast<int>(std::ceil(duration * rate - 1e-3)) + 1, 2);
+	float error = 0.0f;
+	float rotation_error = 0.0f;
+
+	std::vector<glm::vec3> new_translation_keys, new_scale_keys;
+	std::vector<glm::quat> new_rotation_keys;
+	std::vector<AnimationPose> new_channels = channels;
+
+	for (size_t channel = 0; channel < new_channels.size(); channel++)
+	{
+		AnimationTrack* tracks = new_channels[channel].tracks;
+
+		error = glm::max(error, ResampleTrack(translation_times, translation_keys, tracks[TRACK_TRANSLATION], rate, key_count, new_translation_keys));
+		rotation_error = glm::max(rotation_error, ResampleTrack(rotation_times, rotation_keys, tracks[TRACK_ROTATION], rate, key_count, new_rotation_keys));
+		error = glm::max(error, ResampleTrack(scale_times, scale_keys, tracks[TRACK_SCALE], rate, key_count, new_scale_keys));
+	}
+
+	if (max_error)
+		*max_error = error;
+	if (max_rotation_error)
+		*max_rotation_error = rotation_error;
+
+	// Distances and angles are checked separately, so the accepted rotation error does not depend on the size of the asset
+	if (error > tolerance || rotation_error > rotation_tolerance)
+		return false;
+
+	channels.swap(new_channels);
+	translation_keys.swap(new_translation_keys);
+	rotation_keys.swap(new_rotation_keys);
+	scale_keys.swap(new_scale_keys);
+
+	// Keyframe times follow from the rate
+	translation_times.clear();
+	rotation_times.clear();
+	scale_times.clear();
+
+	sample_rate = rate;
+	max_frames = key_count;
+
+	return true;
+}
+
+float AnimationClip::Compress(const Skeleton& skeleton, float tolerance)
+{
+	// Already compressed
+	if (!compressed_keys.empty())
+		return 0.0f;
+
+	// Shell distance of every joint: the length of its longest child bone, or its own length for leaf joints
+	const int joint_count = skeleton.GetJointCount();
+	std::vector<float> shell_distances(joint_count, 0.0f);
+	for (int joint = 0; joint < joint_count; joint++)
+	{
+		const int parent = skeleton.parents[joint];
+		if (parent >= 0)
+			shell_distances[parent] = glm::max(shell_distances[parent], glm::length(skeleton.bind_translations[joint]));
+	}
+	for (int joint = 0; joint < joint_count; joint++)
+	{
+		if (shell_distances[joint] <= 0.0f)
+			shell_distances[joint] = glm::length(skeleton.bind_translations[joint]);
+		if (shell_distances[joint] <= 0.0f)
+			shell_distances[joint] = 1.0f;
+	}
+
+	std::vector<uint8_t> stream;
+	size_t bit_position = 0;
+	float max_error = 0.0f;
+
+	for (size_t channel = 0; channel < channels.size(); channel++)
+	{
+		AnimationTrack* tracks = channels[channel].tracks;
+		const int joint = channel_joints[channel];
+		const float shell_distance = joint >= 0 ? shell_distances[joint] : 1.0f;
+
+		if (tracks[TRACK_TRANSLATION].key_count > 0)
+			max_error = glm::max(max_error, CompressVectorTrack(translation_keys, tracks[TRACK_TRANSLATION], TranslationError, shell_distance, tolerance, stream, bit_position));
+		if (tracks[TRACK_ROTATION].key_count > 0)
+			max_error = glm::max(max_error, CompressRotationTrack(rotation_keys, tracks[TRACK_ROTATION], shell_distance, tolerance, stream, bit_position));
+		if (tracks[TRACK_SCALE].key_count > 0)
+			max_error = glm::max(max_error, CompressVectorTrack(scale_keys, tracks[TRACK_SCALE], ScaleError, shell_distance, tolerance, stream, bit_position));
+	}
+
+	// Padding for the read window of ReadBits
+	stream.resize((bit_position + 7) / 8 + 2, 0);
+	compressed_keys.swap(stream);
+
+	// Keyframe times are still used to find segments, the values are only read from the stream
+	std::vector<glm::vec3>().swap(translation_keys);
+	std::vector<glm::quat>().swap(rotation_keys);
+	std::vector<glm::vec3>().swap(scale_keys);
+
+	return max_error;
+}
+
+size_t AnimationClip::GetKeyframeMemory() const
+{
+	return (translation_times.size() + rotation_times.size() + scale_times.size()) * sizeof(float)
+		+ (translation_keys.size() + scale_keys.size()) * sizeof(glm::vec3)
+		+ rotation_keys.size() * sizeof(glm::quat)
+		+ compressed_keys.size()
+		+ cubic_segments.size() * sizeof(glm::vec3)
+		+ squad_controls.size() * sizeof(glm::quat);
+}
+
+glm::quat AnimationClip::ComputeSquadControl(const glm::quat& previous_key, const glm::quat& key, const glm::quat& next_key)
+{
+	// Neighbours on the same hemisphere as the keyframe, q and -q are the same rotation
+	const glm::quat previous = glm::dot(key, previous_key) < 0.0f ? -previous_key : previous_key;
+	const glm::quat next = glm::dot(key, next_key) < 0.0f ? -next_key : next_key;
+
+	const glm::quat inverse = glm::conjugate(key);
+	return glm::normalize(key * QuatExp(-0.25f * (QuatLog(inverse * next) + QuatLog(inverse * previous))));
+}
+
+void AnimationClip::PrecomputeCubicSegments()
+{
+	cubic_segments.clear();
+	squad_controls.clear();
+
+	const Track_Type cubic_types[] = { TRACK_TRANSLATION, TRACK_SCALE };
+	for (AnimationPose& pose : channels)
+	{
+		for (Track_Type type : cubic_types)
+		{
+			AnimationTrack& track = pose.tracks[type];
+			track.first_segment = -1;
+
+			if (track.mode != TRACK_ANIMATED || track.key_count < 2 || track.bit_rate > 0)
+				continue;
+
+			track.first_segment = static_cast<int>(cubic_segments.size() / 4);
+
+			// The segment from key to key + 1 also depends on the keyframes before and after it, clamped at the ends
+			const int last_key = track.key_count - 1;
+			for (int key = 0; key < last_key; key++)
+			{
+				glm::vec3 p0, p1, p2, p3, coefficients[4];
+				GetKey(type, track, std::max(key - 1, 0), p0);
+				GetKey(type, track, key, p1);
+				GetKey(type, track, key + 1, p2);
+				GetKey(type, track, std::min(key + 2, last_key), p3);
+
+				cubicCoefficients(p0, p1, p2, p3, coefficients);
+				cubic_segments.insert(cubic_segments.end(), coefficients, coefficients + 4);
+			}
+		}
+
+		AnimationTrack& track = pose.tracks[TRACK_ROTATION];
+		track.first_segment = -1;
+
+		if (track.mode != TRACK_ANIMATED || track.key_count < 2 || track.bit_rate > 0)
+			continue;
+
+		track.first_segment = static_cast<int>(squad_controls.size());
+
+		// One control rotation per keyframe, the ends use themselves as missing neighbour
+		const int last_key = track.key_count - 1;
+		for (int key = 0; key <= last_key; key++)
+		{
+			glm::quat previous_key, current_key, next_key;
+			GetKey(TRACK_ROTATION, track, std::max(key - 1, 0), previous_key);
+			GetKey(TRACK_ROTATION, track, key, current_key);
+			GetKey(TRACK_ROTATION, track, std::min(key + 1, last_key), next_key);
+
+			squad_controls.push_back(ComputeSquadControl(previous_key, current_key, next_key));
+		}
+	}
+}
+
+glm::vec3 AnimationClip::DecompressVector(const AnimationTrack& track, int key) const
+{
+	size_t bit_position = static_cast<size_t>(track.bit_offset) + static_cast<size_t>(key) * 3 * track.bit_rate;
+
+	uint32_t quantized[3];
+	for (int i = 0; i < 3; i++, bit_position += track.bit_rate)
+		quantized[i] = ReadBits(compressed_keys.data(), bit_position, track.bit_rate);
+
+	return DequantizeVector(quantized, track);
+}
+
+glm::quat AnimationClip::DecompressRotation(const AnimationTrack& track, int key) const
+{
+	size_t bit_position = static_cast<size_t>(track.bit_offset) + static_cast<size_t>(key) * (2 + 3 * track.bit_rate);
+
+	uint32_t quantized[4];
+	quantized[0] = ReadBits(compressed_keys.data(), bit_position, 2);
+	bit_position += 2;
+	for (int i = 1; i < 4; i++, bit_position += track.bit_rate)
+		quantized[i] = ReadBits(compressed_keys.data(), bit_position, track.bit_rate);
+
+	return DequantizeRotation(quantized, track.bit_rate);
+}
+
+const AnimationPose* AnimationClip::FindChannel(const std::string& bone_name) const
+{
+	auto channel_it = channel_map.find(bone_name);
+	if (channel_it == channel_map.end())
+		return nullptr;
+
+	return &channels[channel_it->second];
+}
+
+int AnimationClip::FindKeyframe(const std::vector<float>& times, const AnimationTrack& track, double time, int* cursor)
+{
+	const float* keys = times.data() + track.first_key;
+	const int last_segment = track.key_count - 2;
+
+	// A single keyframe has no segments
+	if (last_segment < 0)
+		return 0;
+
+	// Walk forward from the previous segment, normal playback only passes a few keyframes per frame
+	if (cursor && *cursor >= 0 && *cursor <= last_segment && keys[*cursor] <= time)
+	{
+		int index = *cursor;
+		for (int step = 0; step < MAX_CURSOR_STEPS && index < last_segment && keys[index + 1] <= time; step++)
+			index++;
+
+		if (index == last_segment || time < keys[index + 1])
+		{
+			*cursor = index;
+			return index;
+		}
+	}
+
+	// Binary search for the last keyframe at or before the given time
+	const float* key_it = std::upper_bound(keys, keys + track.key_count, time, [](double t, float key_time) { return t < key_time; });
+	int index = glm::clamp(static_cast<int>(key_it - keys) - 1, 0, last_segment);
+
+	if (cursor)
+		*cursor = index;
+
+	return index;
+}
+
+float AnimationClip::GetInterpolationFactor(float key_time, float next_key_time, double time)
+{
+	const float key_delta = next_key_time - key_time;
+
+	if (key_delta <= 0.0f)
+		return 0.0f;
+
+	return glm::clamp(static_cast<float>((time - key_time) / key_delta), 0.0f, 1.0f);
+}
+
+int AnimationClip::FindSegment(Track_Type type, const AnimationTrack& track, double time, int* cursor, float* factor) const
+{
+	// Resampled clips: frame = time * rate
+	if (sample_rate > 0.0f)
+		return GetUniformSegment(sample_rate, track.key_count, time, factor);
+
+	const std::vector<float>& times = GetTrackTimes(type);
+	const int index = FindKeyframe(times, track, time, cursor);
+	const int key = track.first_key + index;
+	const int next_key = track.first_key + std::min(index + 1, track.key_count - 1);
+
+	*factor = GetInterpolationFactor(times[key], times[next_key], time);
+
+	return index;
+}
+
+// Reads a keyframe (relative to the track) from the clip, compressed or not
+template <typename T>
+static inline T GetTrackKey(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, int key)
+{
+	T value;
+	clip.GetKey(type, track, key, value);
+	return value;
+}
+
+// Returns a single keyframe of a track, returns default_value for tracks without keyframes
+template <typename T>
+static inline T SampleTrackFrame(const AnimationClip& clip, Track_Type type, const AnimationTrack& track, int frame, const T& default_value)
+{
+	if (track.mode == TRACK_ANIMATED)
+		return GetTrackKey<T>(clip, type, track, std::min(frame, track.key_count - 1));
+
+	return track.mode == TRACK_CONSTANT ? GetTrackKey<T>(clip, type, track, 0) : default_value;
+}
+
+void AnimationClip::Evaluate(double time, Interpolation_Mode interpolation, SQTBatch& pose, std::vector<int>* key_cursors, const int* joint_lod, int lod) const
+{
+	// Pick the specialized loop once, instead of per track
+	switch (interpolation)
+	{
+	case INTERPOLATION_STEP:
+		Evaluate<StepSampler>(time, pose, key_cursors, joint_lod, lod);
+		break;
+	case INTERPOLATION_CUBIC:
+		Evaluate<CubicSampler>(time, pose, key_cursors, joint_lod, lod);
+		break;
+	default:
+		Evaluate<LinearSampler>(time, pose, key_cursors, joint_lod, lod);
+		break;
+	}
+}
+
+template <typename Sampler>
+void AnimationClip::Evaluate(double time, SQTBatch& pose, std::vector<int>* key_cursors, const int* joint_lod, int lod) const
+{
+	pose.Clear();
+
+	// Cursors are only (re)allocated when the clip changes
+	if (key_cursors && key_cursors->size() != channels.size() * TRACK_COUNT)
+		key_cursors->assign(channels.size() * TRACK_COUNT, 0);
+
+	for (size_t channel = 0; channel < channels.size(); channel++)
+	{
+		const int joint = channel_joints[channel];
+		if (joint < 0 || channels[channel].bind_pose || (joint_lod && joint_lod[joint] < lod))
+			continue;
+
+		const AnimationTrack* tracks = channels[channel].tracks;
+		const SQT& defaults = channel_defaults[channel];
+		int* cursors = key_cursors ? &(*key_cursors)[channel * TRACK_COUNT] : nullptr;
+
+		// Interpolate scale, rotation and translation, each on its own keyframes
+		const glm::vec3 scale = SampleTrack<Sampler>(TRACK_SCALE, tracks[TRACK_SCALE], time, cursors ? cursors + TRACK_SCALE : nullptr, defaults.scale);
+		const glm::quat rotation = SampleTrack<Sampler>(TRACK_ROTATION, tracks[TRACK_ROTATION], time, cursors ? cursors + TRACK_ROTATION : nullptr, defaults.rotation);
+		const glm::vec3 translation = SampleTrack<Sampler>(TRACK_TRANSLATION, tracks[TRACK_TRANSLATION], time, cursors ? cursors + TRACK_TRANSLATION : nullptr, defaults.translation);
+
+		pose.Add(joint, translation, rotation, scale);
+	}
+}
+
+void AnimationClip::Evaluate(const double* times, int time_count, Interpolation_Mode interpolation, SQTBatch* poses) const
+{
+	switch (interpolation)
+	{
+	case INTERPOLATION_STEP:
+		Evaluate<StepSampler>(times, time_count, poses);
+		break;
+	case INTERPOLATION_CUBIC:
+		Evaluate<CubicSampler>(times, time_count, poses);
+		break;
+	default:
+		Evaluate<LinearSampler>(times, time_count, poses);
+		break;
+	}
+}
+
+template <typename Sampler>
+void AnimationClip::Evaluate(const double* times, int time_count, SQTBatch* poses) const
+{
+	for (int i = 0; i < time_count; i++)
+		poses[i].Clear();
+
+	for (size_t channel = 0; channel < channels.size(); channel++)
+	{
+		const int joint = channel_joints[channel];
+		if (joint < 0 || channels[channel].bind_pose)
+			continue;
+
+		const AnimationTrack* tracks = channels[channel].tracks;
+		const SQT& defaults = channel_defaults[channel];
+
+		// Cursors of this channel only, they walk forward while the times ascend
+		int cursors[TRACK_COUNT] = { 0, 0, 0 };
+
+		for (int i = 0; i < time_count; i++)
+		{
+			const glm::vec3 scale = SampleTrack<Sampler>(TRACK_SCALE, tracks[TRACK_SCALE], times[i], &cursors[TRACK_SCALE], defaults.scale);
+			const glm::quat rotation = SampleTrack<Sampler>(TRACK_ROTATION, tracks[TRACK_ROTATION], times[i], &cursors[TRACK_ROTATION], defaults.rotation);
+			const glm::vec3 translation = SampleTrack<Sampler>(TRACK_TRANSLATION, tracks[TRACK_TRANSLATION], times[i], &cursors[TRACK_TRANSLATION], defaults.translation);
+
+			poses[i].Add(joint, translation, rotation, scale);
+		}
+	}
+}
+
+// The sampler policies of PosePipeline.hpp
+template void AnimationClip::Evaluate<StepSampler>(double, SQTBatch&, std::vector<int>*, const int*, int) const;
+template void AnimationClip::Evaluate<LinearSampler>(double, SQTBatch&, std::vector<int>*, const int*, int) const;
+template void AnimationClip::Evaluate<CubicSampler>(double, SQTBatch&, std::vector<int>*, const int*, int) const;
+template void AnimationClip::Evaluate<StepSampler>(const double*, int, SQTBatch*) const;
+template void AnimationClip::Evaluate<LinearSampler>(const double*, int, SQTBatch*) const;
+template void AnimationClip::Evaluate<CubicSampler>(const double*, int, SQTBatch*) const;
+
+void AnimationClip::EvaluateKeyframe(int frame, SQTBatch& pose) const
+{
+	pose.Clear();
+
+	for (size_t channel = 0; channel < channels.size(); channel++)
+	{
+		const int joint = channel_joints[channel];
+		if (joint < 0 || channels[channel].bind_pose)
+			continue;
+
+		const AnimationTrack* tracks = channels[channel].tracks;
+		const SQT& defaults = channel_defaults[channel];
+
+		const glm::vec3 scale = SampleTrackFrame(*this, TRACK_SCALE, tracks[TRACK_SCALE], frame, defaults.scale);
+		const glm::quat rotation = SampleTrackFrame(*this, TRACK_ROTATION, tracks[TRACK_ROTATION], frame, defaults.rotation);
+		const glm::vec3 translation = SampleTrackFrame(*this, TRACK_TRANSLATION, tracks[TRACK_TRANSLATION], frame, defaults.translation);
+
+		pose.Add(joint, translation, rotation, scale);
+	}
 }
 
 int AnimationClip::GetFrameNum()
@@ -1,28 +1,64 @@
 #include <AnimationPlayer.hpp>
 
-AnimationPlayer::AnimationPlayer(int anim_index, Mesh* mesh) : current_anim(anim_index), tgt_mesh(mesh)
+#include <iostream>
+
+// Advances the time of a clip, which restarts once it exceeds its duration
+static inline double AdvanceTime(double time, double delta, double duration)
+{
+	const double new_time = time + delta;
+	return new_time > duration ? 0.0 : new_time;
+}
+
+// Blends source over target with the given weight, optionally scaled per joint by mask (joints past mask_size are not blended)
+static void BlendLocalPoses(std::vector<SQT>& target, const std::vector<SQT>& source, float weight, const float* mask, size_t mask_size)
 {
+	for (size_t joint = 0; joint < target.size(); joint++)
+	{
+		const float t = mask ? (joint < mask_size ? weight * mask[joint] : 0.0f) : weight;
+		if (t <= 0.0f)
+			continue;
+
+		SQT& sqt = target[joint];
+		const SQT& other = source[joint];
 
+		sqt.translation += t * (other.translation - sqt.translation);
+		sqt.scale += t * (other.scale - sqt.scale);
+
+		// Normalized lerp along the shortest path, close enough to slerp for blending and much cheaper
+		const glm::quat rotation = glm::dot(sqt.rotation, other.rotation) < 0.0f ? -other.rotation : other.rotation;
+		sqt.rotation = glm::normalize(sqt.rotation * (1.0f - t) + rotation * t);
+	}
+}
+
+AnimationPlayer::AnimationPlayer(int anim_index, Mesh* mesh) : current_anim(anim_index), tgt_mesh(mesh), clip(nullptr)
+{
+	if (tgt_mesh && tgt_mesh->HasAnimations())
+		clip = tgt_mesh->GetAnimation(current_anim);
 }
 
 double AnimationPlayer::UpdateTime(double global_time, float animation_speed)
 {
 	// If animation is paused, return
-	if (!is_playing)
+	if (!is_playing || !clip)
 		return animation_time;
 
-	double new_time = animation_time + global_time * animation_speed;
+	const double delta = global_time * animation_speed;
 
-	// Check whether time exceeds animation duration, then reset
-	if (new_time > tgt_mesh->GetAnimation(current_anim).duration)
+	// The faded out clip and the layers keep playing
+	if (fade_clip)
 	{
-		ResetTime();
+		fade_time = AdvanceTime(fade_time, delta, fade_clip->duration);
+		fade_elapsed += delta;
 
-		return animation_time;
+		if (fade_elapsed >= fade_duration)
+			fade_clip = nullptr;
 	}
 
-	// Update time
-	animation_time = new_time;
+	for (AnimationLayer& layer : layers)
+		layer.time = AdvanceTime(layer.time, delta, layer.clip->duration);
+
+	// Check whether time exceeds animation duration, then reset
+	animation_time = AdvanceTime(animation_time, delta, clip->duration);
 
 	return animation_time;
 }
@@ -31,6 +67,188 @@ void AnimationPlayer::SetValues(int anim_index, Mesh* mesh)
 {
 	tgt_mesh = mesh;
 	current_anim = anim_index;
+	clip = tgt_mesh && tgt_mesh->HasAnimations() ? tgt_mesh->GetAnimation(current_anim) : nullptr;
+	key_cursors.clear();
+
+	// Blending and the evaluated palettes refer to the previous mesh
+	fade_clip = nullptr;
+	layers.clear();
+	ResetLODHistory();
+	pose_dirty = true;
+
+	ResetTime();
+}
+
+void AnimationPlayer::SetBaked(bool baked)
+{
+	use_baked = baked;
+	pose_dirty = true;
+}
+
+void AnimationPlayer::CrossFade(int anim_index, double duration)
+{
+	if (!tgt_mesh || anim_index < 0 || anim_index >= tgt_mesh->GetAnimationCount())
+		return;
+
+	// The current clip becomes the faded out clip, a running cross-fade is cut short
+	if (clip && duration > 0.0)
+	{
+		fade_clip = clip;
+		fade_time = animation_time;
+		fade_elapsed = 0.0;
+		fade_duration = duration;
+		fade_cursors.swap(key_cursors);
+	}
+	else
+	{
+		fade_clip = nullptr;
+	}
+
+	current_anim = anim_index;
+	clip = tgt_mesh->GetAnimation(current_anim);
+	key_cursors.clear();
+	pose_dirty = true;
 
 	ResetTime();
-}
\ No newline at end of file
+}
+
+int AnimationPlayer::SelectLOD(float screen_size)
+{
+	if (screen_size < LOD_QUARTER_SCREEN_SIZE)
+		return 2;
+	if (screen_size < LOD_HALF_SCREEN_SIZE)
+		return 1;
+
+	return 0;
+}
+
+int AnimationPlayer::AddLayer(int anim_index, float weight, const std::vector<float>& bone_mask)
+{
+	if (!tgt_mesh || anim_index < 0 || anim_index >= tgt_mesh->GetAnimationCount())
+		return -1;
+
+	// Masks are indexed by joint, so they have to be built for the (pruned) skeleton of the mesh
+	if (!bone_mask.empty() && static_cast<int>(bone_mask.size()) != tgt_mesh->GetSkeleton().GetJointCount())
+	{
+		std::cout << "ERROR::ANIMATION_PLAYER::Bone mask has " << bone_mask.size() << " weights, the skeleton has " << tgt_mesh->GetSkeleton().GetJointCount() << " joints!" << std::endl;
+		return -1;
+	}
+
+	AnimationLayer layer;
+	layer.anim_index = anim_index;
+	layer.clip = tgt_mesh->GetAnimation(anim_index);
+	layer.weight = weight;
+	layer.bone_mask = bone_mask;
+	layers.push_back(layer);
+	pose_dirty = true;
+
+	return static_cast<int>(layers.size()) - 1;
+}
+
+void AnimationPlayer::SharePose(const AnimationPlayer* source)
+{
+	shared_pose = source && source != this ? &source->pose : nullptr;
+
+	// The own pose falls behind while it is not evaluated
+	if (shared_pose)
+		pose_dirty = true;
+}
+
+bool AnimationPlayer::IsPoseCurrent(Interpolation_Mode interpolation, Skinning_Mode skinning) const
+{
+	// Time is compared exactly, it is only changed by UpdateTime and the setters
+	return !pose_dirty && clip == evaluated_clip && animation_time == evaluated_time && interpolation == evaluated_interpolation && skinning == evaluated_skinning && lod == evaluated_lod;
+}
+
+void AnimationPlayer::Evaluate(Interpolation_Mode interpolation, Skinning_Mode skinning)
+{
+	if (!tgt_mesh || !clip || IsPoseCurrent(interpolation, skinning))
+		return;
+
+	pose_dirty = false;
+	evaluated_clip = clip;
+	evaluated_time = animation_time;
+	evaluated_interpolation = interpolation;
+	evaluated_skinning = skinning;
+	evaluated_lod = lod;
+
+	// Full rate, no history needed
+	if (lod <= 0)
+	{
+		ResetLODHistory();
+		EvaluateFrame(interpolation, skinning);
+		return;
+	}
+
+	// The history can only be blended if it matches the skinning mode
+	if (skinning != lod_skinning)
+	{
+		ResetLODHistory();
+		lod_skinning = skinning;
+	}
+
+	// The phase offsets the evaluations of instances at the same LOD, so the work is spread over the frames
+	const unsigned int interval = 1u << glm::min(lod, MAX_ANIMATION_LOD);
+	const unsigned int step = (lod_frame++ + static_cast<unsigned int>(lod_phase)) % interval;
+
+	if (step != 0 && lod_history_count == 2)
+	{
+		const PoseSnapshot& older = lod_history[1 - lod_newest];
+		const PoseSnapshot& newer = lod_history[lod_newest];
+
+		BlendPalettes(older.GetFrame(), newer.GetFrame(), newer.bone_count, static_cast<int>(newer.bone_vertices.size()), static_cast<float>(step) / interval, skinning, pose);
+		return;
+	}
+
+	EvaluateFrame(interpolation, skinning);
+
+	lod_newest = 1 - lod_newest;
+	lod_history[lod_newest].Store(pose, skinning);
+	lod_history_count = glm::min(lod_history_count + 1, 2);
+
+	// Show the previous evaluation, the frames until the next one blend towards the new palettes
+	if (lod_history_count == 2)
+	{
+		const PoseSnapshot& older = lod_history[1 - lod_newest];
+		BlendPalettes(older.GetFrame(), older.GetFrame(), older.bone_count, static_cast<int>(older.bone_vertices.size()), 0.0f, skinning, pose);
+	}
+}
+
+void AnimationPlayer::EvaluateFrame(Interpolation_Mode interpolation, Skinning_Mode skinning)
+{
+	bool blending = fade_clip != nullptr;
+	for (const AnimationLayer& layer : layers)
+		blending = blending || layer.weight > 0.0f;
+
+	// A single clip goes straight to the palette
+	if (!blending)
+	{
+		if (use_baked && tgt_mesh->IsAnimationBaked(current_anim, interpolation))
+			tgt_mesh->EvaluateBakedPose(pose, current_anim, animation_time, skinning);
+		else
+			tgt_mesh->EvaluatePose(pose, *clip, animation_time, interpolation, skinning, &key_cursors, lod);
+		return;
+	}
+
+	// Every cross-fade and layer costs one extra sample and blend, the local poses keep their capacity between frames
+	tgt_mesh->SampleLocalPose(*clip, animation_time, interpolation, &key_cursors, layer_samples, blended_pose, lod);
+
+	if (fade_clip)
+	{
+		const float fade_weight = static_cast<float>(glm::clamp(fade_elapsed / fade_duration, 0.0, 1.0));
+
+		tgt_mesh->SampleLocalPose(*fade_clip, fade_time, interpolation, &fade_cursors, layer_samples, layer_pose, lod);
+		BlendLocalPoses(blended_pose, layer_pose, 1.0f - fade_weight, nullptr, 0);
+	}
+
+	for (AnimationLayer& layer : layers)
+	{
+		if (layer.weight <= 0.0f)
+			continue;
+
+		tgt_mesh->SampleLocalPose(*layer.clip, layer.time, interpolation, &layer.key_cursors, layer_samples, layer_pose, lod);
+		BlendLocalPoses(blended_pose, layer_pose, layer.weight, layer.bone_mask.empty() ? nullptr : layer.bone_mask.data(), layer.bone_mask.size());
+	}
+
+	tgt_mesh->EvaluateLocalPose(pose, blended_pose, skinning);
+}
@@ -0,0 +1,118 @@
+#include <AnimationWorkerPool.hpp>
+
+#include <algorithm>
+
+AnimationWorkerPool::AnimationWorkerPool(unsigned int n_threads) : next_job(0), pending_jobs(0)
+{
+	// Leave one core for the render thread
+	if (n_threads == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		n_threads = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < n_threads; i++)
+		workers.push_back(std::thread(&AnimationWorkerPool::WorkerLoop, this));
+}
+
+AnimationWorkerPool::~AnimationWorkerPool()
+{
+	Wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	work_available.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void AnimationWorkerPool::Dispatch(const std::vector<AnimationPlayer*>& players, Interpolation_Mode interpolation, Skinning_Mode skinning)
+{
+	if (players.empty())
+		return;
+
+	{
+		// Wait for the previous dispatch while holding the lock, so no worker can pick up the old jobs in between
+		std::unique_lock<std::mutex> lock(mutex);
+		work_done.wait(lock, [this] { return pending_jobs.load() == 0 && active_workers == 0; });
+
+		jobs.assign(players.begin(), players.end());
+		interpolation_mode = interpolation;
+		skinning_mode = skinning;
+		range_job = nullptr;
+		job_count = static_cast<int>(jobs.size());
+		next_job = 0;
+		pending_jobs = job_count;
+		generation++;
+	}
+	work_available.notify_all();
+}
+
+void AnimationWorkerPool::DispatchRange(int count, int grain, const std::function<void(int, int)>& job)
+{
+	if (count <= 0 || !job)
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		work_done.wait(lock, [this] { return pending_jobs.load() == 0 && active_workers == 0; });
+
+		jobs.clear();
+		range_job = job;
+		range_count = count;
+		range_grain = grain > 0 ? grain : 1;
+		job_count = (count + range_grain - 1) / range_grain;
+		next_job = 0;
+		pending_jobs = job_count;
+		generation++;
+	}
+	work_available.notify_all();
+}
+
+void AnimationWorkerPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	work_done.wait(lock, [this] { return pending_jobs.load() == 0 && active_workers == 0; });
+}
+
+void AnimationWorkerPool::WorkerLoop()
+{
+	unsigned int last_generation = 0;
+
+	while (true)
+	{
+		int dispatched_jobs;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_available.wait(lock, [this, last_generation] { return stop || generation != last_generation; });
+
+			if (stop)
+				return;
+
+			last_generation = generation;
+			dispatched_jobs = job_count;
+			active_workers++;
+		}
+
+		// Take jobs until none are left, instances play different clips so their cost varies
+		for (int job = next_job++; job < dispatched_jobs; job = next_job++)
+		{
+			if (range_job)
+				range_job(job * range_grain, std::min((job + 1) * range_grain, range_count));
+			else
+				jobs[job]->Evaluate(interpolation_mode, skinning_mode);
+			pending_jobs--;
+		}
+
+		// Let the render thread check whether all workers are done
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			active_workers--;
+		}
+		work_done.notify_all();
+	}
+}
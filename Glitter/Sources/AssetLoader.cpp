@@ -18,7 +18,7 @@ AssetLoader::AssetLoader()
     // 
 }
 
-void AssetLoader::Load(std::string const& expr, Shader& shader)
+void AssetLoader::Load(std::string const& expr, Shader& shader, const AnimationImportSettings& import_settings)
 {
 #ifdef _WIN32
     WIN32_FIND_DATA fileFindData = {};
@@ -38,7 +38,7 @@ void AssetLoader::Load(std::string const& expr, Shader& shader)
 
         Asset* pAsset = new Asset{
             std::string(fileFindData.cFileName),
-            std::unique_ptr<Mesh>(new Mesh(path, &shader))
+            std::unique_ptr<Mesh>(new Mesh(path, &shader, import_settings))
         };
 
         m_assets.push_back(
@@ -60,7 +60,7 @@ void AssetLoader::Load(std::string const& expr, Shader& shader)
     {
         Asset* pAsset = new Asset{
             std::string(globResult.gl_pathv[i]),
-            std::unique_ptr<Mesh>(new Mesh(globResult.gl_pathv[i], &shader))
+            std::unique_ptr<Mesh>(new Mesh(globResult.gl_pathv[i], &shader, import_settings))
         };
 
         m_assets.push_back(
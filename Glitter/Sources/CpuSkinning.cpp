@@ -0,0 +1,351 @@
+#include <CpuSkinning.hpp>
+
+#include <iostream>
+
+#if defined(POSE_KERNELS_AVX)
+#include <immintrin.h>
+#elif defined(POSE_KERNELS_SSE)
+#include <emmintrin.h>
+#endif
+
+void SkinnedVertices::Resize(size_t vertex_count)
+{
+	positions.resize(vertex_count);
+	normals.resize(vertex_count);
+	tangents.resize(vertex_count);
+}
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+static inline void StoreVec3(__m128 v, glm::vec3& out)
+{
+	alignas(16) float f[4];
+	_mm_store_ps(f, v);
+	out = glm::vec3(f[0], f[1], f[2]);
+}
+
+// Transforms position, normal and tangent of a vertex by the columns of an affine transform (c3 is the translation)
+static inline void TransformVertex(const Vertex& vertex, __m128 c0, __m128 c1, __m128 c2, __m128 c3, SkinnedVertices& skinned, int i)
+{
+	__m128 p = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.position.x)), c3);
+	p = _mm_add_ps(p, _mm_mul_ps(c1, _mm_set1_ps(vertex.position.y)));
+	p = _mm_add_ps(p, _mm_mul_ps(c2, _mm_set1_ps(vertex.position.z)));
+
+	__m128 n = _mm_mul_ps(c0, _mm_set1_ps(vertex.normal.x));
+	n = _mm_add_ps(n, _mm_mul_ps(c1, _mm_set1_ps(vertex.normal.y)));
+	n = _mm_add_ps(n, _mm_mul_ps(c2, _mm_set1_ps(vertex.normal.z)));
+
+	__m128 t = _mm_mul_ps(c0, _mm_set1_ps(vertex.tangent.x));
+	t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(vertex.tangent.y)));
+	t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(vertex.tangent.z)));
+
+	StoreVec3(p, skinned.positions[i]);
+	StoreVec3(n, skinned.normals[i]);
+	StoreVec3(t, skinned.tangents[i]);
+}
+
+// Multiplies the columns of an affine transform by a (blended) scale matrix from the right, like qt * finalScale in the shader
+static inline void ApplyScale(const glm::mat4& scale, __m128& c0, __m128& c1, __m128& c2, __m128& c3)
+{
+	__m128 columns[4];
+	for (int j = 0; j < 4; j++)
+	{
+		columns[j] = _mm_mul_ps(c0, _mm_set1_ps(scale[j][0]));
+		columns[j] = _mm_add_ps(columns[j], _mm_mul_ps(c1, _mm_set1_ps(scale[j][1])));
+		columns[j] = _mm_add_ps(columns[j], _mm_mul_ps(c2, _mm_set1_ps(scale[j][2])));
+		columns[j] = _mm_add_ps(columns[j], _mm_mul_ps(c3, _mm_set1_ps(scale[j][3])));
+	}
+
+	c0 = columns[0];
+	c1 = columns[1];
+	c2 = columns[2];
+	c3 = columns[3];
+}
+#else
+static inline void TransformVertex(const Vertex& vertex, const glm::vec3 columns[4], SkinnedVertices& skinned, int i)
+{
+	skinned.positions[i] = columns[0] * vertex.position.x + columns[1] * vertex.position.y + columns[2] * vertex.position.z + columns[3];
+	skinned.normals[i] = columns[0] * vertex.normal.x + columns[1] * vertex.normal.y + columns[2] * vertex.normal.z;
+	skinned.tangents[i] = columns[0] * vertex.tangent.x + columns[1] * vertex.tangent.y + columns[2] * vertex.tangent.z;
+}
+
+// Multiplies the columns of an affine transform by a (blended) scale matrix from the right, like qt * finalScale in the shader
+static inline void ApplyScale(const glm::mat4& scale, glm::vec3 columns[4])
+{
+	glm::vec3 scaled[4];
+	for (int j = 0; j < 4; j++)
+		scaled[j] = columns[0] * scale[j][0] + columns[1] * scale[j][1] + columns[2] * scale[j][2] + columns[3] * scale[j][3];
+
+	for (int j = 0; j < 4; j++)
+		columns[j] = scaled[j];
+}
+#endif
+
+// Linear blend of the bone scales of a vertex, with the weights as they are (the scales have no hemisphere)
+static inline glm::mat4 BlendScales(const Vertex& vertex, const glm::mat4* scale_transforms)
+{
+	glm::mat4 scale(0.0f);
+	for (int k = 0; k < MAXIMUM_BONES; k++)
+		scale += scale_transforms[vertex.boneIDs[k]] * vertex.weights[k];
+
+	return scale;
+}
+
+void SkinLinear(const Vertex* vertices, int begin, int end, const AffineTransform* palette, SkinnedVertices& skinned)
+{
+	for (int i = begin; i < end; i++)
+	{
+		const Vertex& vertex = vertices[i];
+
+		// Weighted sum of the bone transforms, unused influences have weight 0 like in the shader
+#if defined(POSE_KERNELS_AVX)
+		__m256 rows01 = _mm256_setzero_ps();
+		__m128 row2 = _mm_setzero_ps();
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+		{
+			const float* bone = &palette[vertex.boneIDs[k]].rows[0].x;
+			rows01 = _mm256_add_ps(rows01, _mm256_mul_ps(_mm256_set1_ps(vertex.weights[k]), _mm256_loadu_ps(bone)));
+			row2 = _mm_add_ps(row2, _mm_mul_ps(_mm_set1_ps(vertex.weights[k]), _mm_loadu_ps(bone + 8)));
+		}
+
+		__m128 c0 = _mm256_castps256_ps128(rows01), c1 = _mm256_extractf128_ps(rows01, 1), c2 = row2, c3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		TransformVertex(vertex, c0, c1, c2, c3, skinned, i);
+#elif defined(POSE_KERNELS_SSE)
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+		{
+			const float* bone = &palette[vertex.boneIDs[k]].rows[0].x;
+			const __m128 weight = _mm_set1_ps(vertex.weights[k]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(weight, _mm_loadu_ps(bone)));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(weight, _mm_loadu_ps(bone + 4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(weight, _mm_loadu_ps(bone + 8)));
+		}
+
+		// Rows to columns, so every attribute is a sum of scaled columns
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		TransformVertex(vertex, c0, c1, c2, c3, skinned, i);
+#else
+		glm::vec4 rows[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+		{
+			for (int row = 0; row < 3; row++)
+				rows[row] += vertex.weights[k] * palette[vertex.boneIDs[k]].rows[row];
+		}
+
+		const glm::vec3 columns[4] = {
+			glm::vec3(rows[0].x, rows[1].x, rows[2].x),
+			glm::vec3(rows[0].y, rows[1].y, rows[2].y),
+			glm::vec3(rows[0].z, rows[1].z, rows[2].z),
+			glm::vec3(rows[0].w, rows[1].w, rows[2].w)
+		};
+		TransformVertex(vertex, columns, skinned, i);
+#endif
+	}
+}
+
+void SkinDualQuat(const Vertex* vertices, int begin, int end, const glm::mat4x2* dual_quats, const glm::mat4* scale_transforms, SkinnedVertices& skinned)
+{
+	for (int i = begin; i < end; i++)
+	{
+		const Vertex& vertex = vertices[i];
+
+		// glm is column-major, so the real and dual parts are interleaved: (rw, dw, rx, dx, ry, dy, rz, dz)
+		const float* first = &dual_quats[vertex.boneIDs[0]][0][0];
+		float real[4], dual[4];
+
+#if defined(POSE_KERNELS_AVX)
+		__m256 blended = _mm256_setzero_ps();
+#elif defined(POSE_KERNELS_SSE)
+		__m128 blended_low = _mm_setzero_ps(), blended_high = _mm_setzero_ps();
+#else
+		float blended[8] = { 0.0f };
+#endif
+
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+		{
+			const float* bone = &dual_quats[vertex.boneIDs[k]][0][0];
+
+			// Blend along the shortest path, relative to the first bone
+			const float hemisphere = first[0] * bone[0] + first[2] * bone[2] + first[4] * bone[4] + first[6] * bone[6];
+			const float weight = hemisphere < 0.0f ? -vertex.weights[k] : vertex.weights[k];
+
+#if defined(POSE_KERNELS_AVX)
+			blended = _mm256_add_ps(blended, _mm256_mul_ps(_mm256_set1_ps(weight), _mm256_loadu_ps(bone)));
+#elif defined(POSE_KERNELS_SSE)
+			blended_low = _mm_add_ps(blended_low, _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(bone)));
+			blended_high = _mm_add_ps(blended_high, _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(bone + 4)));
+#else
+			for (int j = 0; j < 8; j++)
+				blended[j] += weight * bone[j];
+#endif
+		}
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+#if defined(POSE_KERNELS_AVX)
+		const __m128 blended_low = _mm256_castps256_ps128(blended), blended_high = _mm256_extractf128_ps(blended, 1);
+#endif
+		_mm_storeu_ps(real, _mm_shuffle_ps(blended_low, blended_high, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(dual, _mm_shuffle_ps(blended_low, blended_high, _MM_SHUFFLE(3, 1, 3, 1)));
+#else
+		for (int j = 0; j < 4; j++)
+		{
+			real[j] = blended[2 * j];
+			dual[j] = blended[2 * j + 1];
+		}
+#endif
+
+		// Same conversion to a matrix as DQToMatrix in the shader, normalizing by the squared length of the real part
+		const float w = real[0], x = real[1], y = real[2], z = real[3];
+		const float t0 = dual[0], t1 = dual[1], t2 = dual[2], t3 = dual[3];
+		const float inv_length2 = 1.0f / (w * w + x * x + y * y + z * z);
+
+		const float m00 = w * w + x * x - y * y - z * z, m01 = 2.0f * (x * y + w * z), m02 = 2.0f * (x * z - w * y);
+		const float m10 = 2.0f * (x * y - w * z), m11 = w * w + y * y - x * x - z * z, m12 = 2.0f * (y * z + w * x);
+		const float m20 = 2.0f * (x * z + w * y), m21 = 2.0f * (y * z - w * x), m22 = w * w + z * z - x * x - y * y;
+		const float m30 = 2.0f * (-t0 * x + w * t1 - t2 * z + y * t3);
+		const float m31 = 2.0f * (-t0 * y + t1 * z - x * t3 + w * t2);
+		const float m32 = 2.0f * (-t0 * z + x * t2 + w * t3 - t1 * y);
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+		const __m128 normalize = _mm_set1_ps(inv_length2);
+		__m128 c0 = _mm_mul_ps(_mm_set_ps(0.0f, m02, m01, m00), normalize);
+		__m128 c1 = _mm_mul_ps(_mm_set_ps(0.0f, m12, m11, m10), normalize);
+		__m128 c2 = _mm_mul_ps(_mm_set_ps(0.0f, m22, m21, m20), normalize);
+		__m128 c3 = _mm_mul_ps(_mm_set_ps(0.0f, m32, m31, m30), normalize);
+		if (scale_transforms)
+			ApplyScale(BlendScales(vertex, scale_transforms), c0, c1, c2, c3);
+		TransformVertex(vertex, c0, c1, c2, c3, skinned, i);
+#else
+		glm::vec3 columns[4] = {
+			glm::vec3(m00, m01, m02) * inv_length2,
+			glm::vec3(m10, m11, m12) * inv_length2,
+			glm::vec3(m20, m21, m22) * inv_length2,
+			glm::vec3(m30, m31, m32) * inv_length2
+		};
+		if (scale_transforms)
+			ApplyScale(BlendScales(vertex, scale_transforms), columns);
+		TransformVertex(vertex, columns, skinned, i);
+#endif
+	}
+}
+
+void SkinVertices(const std::vector<Vertex>& vertices, const PoseBuffer& pose, Skinning_Mode skinning, SkinnedVertices& skinned, AnimationWorkerPool* workers)
+{
+	const bool dual_quat = IsDualQuatSkinning(skinning);
+	const bool scale = skinning == SKINNING_SCALED_DUAL_QUAT;
+
+	// Every vertex reads at least bone 0, so a mesh without bones or a pose that was never evaluated cannot be skinned
+	if (dual_quat ? pose.dual_quats.empty() : pose.palette.empty())
+	{
+		std::cout << "ERROR::Pose has no palette for skinning!" << std::endl;
+		return;
+	}
+
+	if (dual_quat && pose.dual_quats.size() != pose.palette.size())
+	{
+		std::cout << "ERROR::Pose has no dual quaternions for skinning!" << std::endl;
+		return;
+	}
+
+	if (scale && pose.scale_transforms.size() != pose.dual_quats.size())
+	{
+		std::cout << "ERROR::Pose has no bone scales for skinning!" << std::endl;
+		return;
+	}
+
+	const int vertex_count = static_cast<int>(vertices.size());
+	skinned.Resize(vertices.size());
+
+	auto skin_range = [&](int begin, int end)
+	{
+		if (dual_quat)
+			SkinDualQuat(vertices.data(), begin, end, pose.dual_quats.data(), scale ? pose.scale_transforms.data() : nullptr, skinned);
+		else
+			SkinLinear(vertices.data(), begin, end, pose.palette.data(), skinned);
+	};
+
+	// Small meshes are not worth waking up the workers
+	if (!workers || workers->GetThreadCount() == 0 || vertex_count <= SKINNING_RANGE_SIZE)
+	{
+		skin_range(0, vertex_count);
+		return;
+	}
+
+	workers->DispatchRange(vertex_count, SKINNING_RANGE_SIZE, skin_range);
+	workers->Wait();
+}
+
+// Palette entry of a vertex as a glm matrix, written the way the vertex shaders read it, without the SIMD kernels
+static glm::mat4 ReferenceSkinMatrix(const Vertex& vertex, const PoseBuffer& pose, Skinning_Mode skinning)
+{
+	if (!IsDualQuatSkinning(skinning))
+	{
+		glm::mat4 matrix(0.0f);
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+			matrix += pose.palette[vertex.boneIDs[k]].ToMat4() * vertex.weights[k];
+
+		return matrix;
+	}
+
+	// Blend the dual quaternions along the shortest path to the first bone, like bone_dq_no_scale_shader.vert
+	const glm::mat4x2& first = pose.dual_quats[vertex.boneIDs[0]];
+	const glm::quat first_real(first[0][0], first[1][0], first[2][0], first[3][0]);
+	glm::quat real(0.0f, 0.0f, 0.0f, 0.0f), dual(0.0f, 0.0f, 0.0f, 0.0f);
+	for (int k = 0; k < MAXIMUM_BONES; k++)
+	{
+		const glm::mat4x2& dq = pose.dual_quats[vertex.boneIDs[k]];
+		const glm::quat bone_real(dq[0][0], dq[1][0], dq[2][0], dq[3][0]);
+		const glm::quat bone_dual(dq[0][1], dq[1][1], dq[2][1], dq[3][1]);
+		const float weight = glm::dot(first_real, bone_real) < 0.0f ? -vertex.weights[k] : vertex.weights[k];
+
+		real = real + bone_real * weight;
+		dual = dual + bone_dual * weight;
+	}
+
+	// Rotation of the normalized real part, translation 2 * dual * conjugate(real)
+	const float length = glm::length(real);
+	real = real / length;
+	dual = dual / length;
+	const glm::quat translation = dual * glm::conjugate(real) * 2.0f;
+
+	glm::mat4 matrix = glm::mat4_cast(real);
+	matrix[3] = glm::vec4(translation.x, translation.y, translation.z, 1.0f);
+
+	// The scale-aware shader scales in bone space, before the rigid transform
+	if (skinning == SKINNING_SCALED_DUAL_QUAT)
+	{
+		glm::mat4 scale(0.0f);
+		for (int k = 0; k < MAXIMUM_BONES; k++)
+			scale += pose.scale_transforms[vertex.boneIDs[k]] * vertex.weights[k];
+
+		matrix = matrix * scale;
+	}
+
+	return matrix;
+}
+
+float ValidateSkinning(const std::vector<Vertex>& vertices, const PoseBuffer& pose, Skinning_Mode skinning, const SkinnedVertices& skinned)
+{
+	if (skinned.positions.size() != vertices.size())
+	{
+		std::cout << "ERROR::Skinned vertices do not match the mesh!" << std::endl;
+		return -1.0f;
+	}
+
+	float max_error = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const Vertex& vertex = vertices[i];
+		const glm::mat4 matrix = ReferenceSkinMatrix(vertex, pose, skinning);
+
+		const glm::vec3 position = glm::vec3(matrix * glm::vec4(vertex.position, 1.0f));
+		const glm::vec3 normal = glm::vec3(matrix * glm::vec4(vertex.normal, 0.0f));
+		const glm::vec3 tangent = glm::vec3(matrix * glm::vec4(vertex.tangent, 0.0f));
+
+		max_error = glm::max(max_error, glm::length(position - skinned.positions[i]));
+		max_error = glm::max(max_error, glm::length(normal - skinned.normals[i]));
+		max_error = glm::max(max_error, glm::length(tangent - skinned.tangents[i]));
+	}
+
+	return max_error;
+}
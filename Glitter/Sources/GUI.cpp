@@ -73,8 +73,16 @@ void GUI::Render()
     ImGui::Text("%s", m_cameraMode.c_str());
     if (ImGui::Button("Switch Camera Modes"))
         GuiButtonCallback(GUI_BUTTON::CAMERA_MODE_TOGGLE);
-    ImGui::Checkbox("Toggle DQS", &m_sceneSettings.dual_quat_skinning_flag);
-    ImGui::Checkbox("Toggle Cubic interpolation", &m_sceneSettings.cubic_interpolation_flag);
+    // Same order as Skinning_Mode and Interpolation_Mode
+    static const char* skinning_modes[] = { "Linear blend", "Dual quaternion", "Dual quaternion with scale" };
+    static const char* interpolation_modes[] = { "Step", "Linear", "Cubic" };
+    ImGui::Combo("Skinning", &m_sceneSettings.skinning_mode, skinning_modes, IM_ARRAYSIZE(skinning_modes));
+    ImGui::Combo("Interpolation", &m_sceneSettings.interpolation_mode, interpolation_modes, IM_ARRAYSIZE(interpolation_modes));
+    ImGui::Checkbox("Toggle baked playback", &m_sceneSettings.baked_playback_flag);
+    ImGui::Checkbox("Toggle animation LOD", &m_sceneSettings.animation_lod_flag);
+    ImGui::SliderFloat("Pose cache step (ms)", &m_sceneSettings.pose_cache_step, 0.0f, 50.0f);
+    ImGui::Text("Pose cache hits: %d, misses: %d", m_sceneSettings.pose_cache_hits, m_sceneSettings.pose_cache_misses);
+    ImGui::SliderInt("Instances", &m_sceneSettings.instance_count, 1, MAX_INSTANCES);
     ImGui::Checkbox("Toggle Skybox", &m_sceneSettings.show_skybox);
     ImGui::Checkbox("Show bones", &m_sceneSettings.show_bones_flag);
     ImGui::End();
@@ -1,7 +1,7 @@
 #include "Mesh.hpp"
 #include "bicubic.hpp"
-#include "cubic.hpp"
 
+#include <cmath>
 #include <iostream>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -21,12 +21,17 @@ Shader Mesh::skeletonShader;
 unsigned int Mesh::m_boneVertexCount;
 unsigned int Mesh::m_skeletonVAO;
 unsigned int Mesh::m_skeletonVBO;
+PaletteRing Mesh::paletteRing;
+unsigned long long Mesh::m_uploadedRevision = 0;
+unsigned long long Mesh::m_uploadedFrame = 0;
+Skinning_Mode Mesh::m_uploadedSkinning = SKINNING_LINEAR_BLEND;
 
-Mesh::Mesh(std::string const& filename, Shader* shader)
+Mesh::Mesh(std::string const& filename, Shader* shader, const AnimationImportSettings& import_settings)
     //:
     //Mesh()
 {
     this->shader = shader;
+    this->m_importSettings = import_settings;
 
     //Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(
@@ -46,9 +51,36 @@ Mesh::Mesh(std::string const& filename, Shader* shader)
         // Set root node
         this->scene = scene;
 
+        // Flatten the node tree and link bones to their joints
+        m_skeleton.Build(scene->mRootNode);
+        for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
+        {
+            auto bone_it = bone_map.find(m_skeleton.names[joint]);
+            if (bone_it != bone_map.end())
+                m_skeleton.bone_ids[joint] = bone_it->second;
+        }
+
+        // Nodes no bone depends on are never evaluated, channels animating them are dropped with the static tracks
+        const int pruned_joints = m_skeleton.Prune();
+        std::cout << "Pruned " << pruned_joints << " nodes without bones from the skeleton" << std::endl;
+        BuildJointLOD();
+
         // Set Inverse Transform Matrix (not needed if we stick to single mesh models)
         inverse_transform = glm::inverse(ConvertMatrixToGLMFormat(scene->mRootNode->mTransformation));
 
+        // Affine and decomposed copies of the bone data for the pose kernels, the DQ pipeline never decomposes at runtime
+        m_inverseTransform = AffineTransform::FromMat4(inverse_transform);
+        m_inverseTransformSQT = DecomposeTransform(inverse_transform);
+        m_boneOffsets.resize(m_bones.size());
+        m_boneOffsetsSQT.resize(m_bones.size());
+        for (size_t i = 0; i < m_bones.size(); i++)
+        {
+            m_boneOffsets[i] = AffineTransform::FromMat4(m_bones[i].offsetMatrix);
+            m_boneOffsetsSQT[i] = DecomposeTransform(m_bones[i].offsetMatrix);
+        }
+
+        PreparePose(m_pose);
+
         // Parse animations
         ParseAnimations(scene);
     }
@@ -65,13 +97,23 @@ Mesh::Mesh(std::vector<Vertex> const& verts, std::vector<unsigned int> const& in
     glGenVertexArrays(1, &m_VAO);
     glBindVertexArray(m_VAO);
 
+    // Quantize the vertices for the GPU, m_vertices keeps the full precision copy for CPU skinning
+    std::vector<PackedVertex> packed_verts;
+    packed_verts.reserve(verts.size());
+    int dropped_influences = 0;
+    for (const Vertex& vertex : verts)
+        packed_verts.push_back(PackVertex(vertex, &dropped_influences));
+
+    if (dropped_influences > 0)
+        std::cout << "ERROR::Dropped " << dropped_influences << " bone influences with IDs outside the packed range [0, " << MAXIMUM_PACKED_BONE_ID << "]!" << std::endl;
+
     // bind & create the vertex buffer
     glGenBuffers(1, &m_VBO);
     glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
     glBufferData(
         GL_ARRAY_BUFFER,
-        verts.size() * sizeof(Vertex),
-        verts.data(),
+        packed_verts.size() * sizeof(PackedVertex),
+        packed_verts.data(),
         GL_STATIC_DRAW
     );
 
@@ -85,29 +127,25 @@ Mesh::Mesh(std::vector<Vertex> const& verts, std::vector<unsigned int> const& in
         GL_STATIC_DRAW
     );
 
-    // Set Shader Attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, position));
+    // Set Shader Attributes, GL decodes the packed formats so the shaders still read floats (and unsigned bone ids)
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
     glEnableVertexAttribArray(0); // Vertex Positions
 
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
     glEnableVertexAttribArray(1); // Vertex Normals
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
     glEnableVertexAttribArray(2);  // Vertex texture coords
 
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
-    glEnableVertexAttribArray(3);     // Vertex tangent
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, tangent));
+    glEnableVertexAttribArray(3);     // Vertex tangent, w is the bitangent handedness
 
-
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, biTangent));
-    glEnableVertexAttribArray(4);  // Vertex bitangent
-
-    glVertexAttribIPointer(5, MAXIMUM_BONES, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, boneIDs));
+    glVertexAttribIPointer(5, MAXIMUM_BONES, GL_UNSIGNED_SHORT, sizeof(PackedVertex), (void*)offsetof(PackedVertex, boneIDs));
     glEnableVertexAttribArray(5);   // Bone ids
 
 
-    glVertexAttribPointer(6, MAXIMUM_BONES, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, weights));
+    glVertexAttribPointer(6, MAXIMUM_BONES, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, weights));
     glEnableVertexAttribArray(6);  // Bone weights
     glBindVertexArray(0);
 }
@@ -125,7 +163,7 @@ void Mesh::PrepareSkeletonBOs() {
     glBindVertexArray(0);
 }
 
-void Mesh::UpdateSkeletonVertices(std::vector<glm::vec3> boneVertices) {
+void Mesh::UpdateSkeletonVertices(const std::vector<glm::vec3>& boneVertices) {
     m_boneVertexCount = boneVertices.size();
 
     glBindBuffer(GL_ARRAY_BUFFER, m_skeletonVBO);
@@ -229,47 +267,84 @@ void Mesh::ParseAnimations(const aiScene* scene)
         for (unsigned int i = 0; i < n_animations; i++)
         {
             aiAnimation* current_animation = scene->mAnimations[i];
+            const double ticks_per_second = current_animation->mTicksPerSecond;
 
-            // TODO: Currently considers same size of all channels (realistic?)
-            // Parse channels
+            // Check keyframe number
             int max_frames = 0;
-            std::map<std::string, AnimationPose> poses;
             for (unsigned int j = 0; j < current_animation->mNumChannels; j++)
             {
                 aiNodeAnim* current_channel = current_animation->mChannels[j];
 
-                std::string channel_bone_name = std::string(current_channel->mNodeName.data);           // Get name of affected node
-
-                // Check keyframe number
                 if (current_channel->mNumPositionKeys > max_frames)
                     max_frames = current_channel->mNumPositionKeys;
                 if (current_channel->mNumRotationKeys > max_frames)
                     max_frames = current_channel->mNumRotationKeys;
                 if (current_channel->mNumScalingKeys > max_frames)
                     max_frames = current_channel->mNumScalingKeys;
+            }
+
+            AnimationClip new_animation_clip = AnimationClip(std::string(current_animation->mName.data), this->m_bones.size(), max_frames, current_animation->mDuration / ticks_per_second, ticks_per_second);
+
+            // Parse channels, every track (translation, rotation, scale) has its own keyframe count and times
+            for (unsigned int j = 0; j < current_animation->mNumChannels; j++)
+            {
+                aiNodeAnim* current_channel = current_animation->mChannels[j];
+
+                std::string channel_bone_name = std::string(current_channel->mNodeName.data);           // Get name of affected node
+
+                // Only the first channel of a node is used
+                int channel = new_animation_clip.AddChannel(channel_bone_name);
+                if (channel < 0)
+                    continue;
 
-                // Parse SQTs of channel
-                std::vector<SQT> sqts;
                 for (unsigned int k = 0; k < current_channel->mNumPositionKeys; k++)
                 {
-                    SQT new_sqt;
-                    new_sqt.time = current_channel->mScalingKeys[k].mTime / current_animation->mTicksPerSecond;
-                    new_sqt.scale = ConvertVector3DToGLMFormat(current_channel->mScalingKeys[k].mValue);
-                    new_sqt.translation = ConvertVector3DToGLMFormat(current_channel->mPositionKeys[k].mValue);
-                    new_sqt.rotation = ConvertQuaternionToGLMFormat(current_channel->mRotationKeys[k].mValue);
+                    const aiVectorKey& key = current_channel->mPositionKeys[k];
+                    new_animation_clip.AddTranslationKey(channel, static_cast<float>(key.mTime / ticks_per_second), ConvertVector3DToGLMFormat(key.mValue));
+                }
+
+                for (unsigned int k = 0; k < current_channel->mNumRotationKeys; k++)
+                {
+                    const aiQuatKey& key = current_channel->mRotationKeys[k];
+                    new_animation_clip.AddRotationKey(channel, static_cast<float>(key.mTime / ticks_per_second), ConvertQuaternionToGLMFormat(key.mValue));
+                }
 
-                    sqts.push_back(new_sqt);
+                for (unsigned int k = 0; k < current_channel->mNumScalingKeys; k++)
+                {
+                    const aiVectorKey& key = current_channel->mScalingKeys[k];
+                    new_animation_clip.AddScaleKey(channel, static_cast<float>(key.mTime / ticks_per_second), ConvertVector3DToGLMFormat(key.mValue));
                 }
+            }
 
-                AnimationPose new_pose;
-                new_pose.bone_name = channel_bone_name;
-                new_pose.bonePoses = sqts;
+            // Resolve channels to skeleton joints once, so evaluation only uses indices
+            new_animation_clip.BindChannels(m_skeleton);
 
-                // Add AnimationPose to map
-                poses.insert({channel_bone_name, new_pose});
+            // Optionally resample to a fixed rate, so sampling does not need to search keyframes
+            const float sample_rate = m_importSettings.sample_rate;
+            if (sample_rate > 0.0f)
+            {
+                float max_error = 0.0f, max_rotation_error = 0.0f;
+                if (new_animation_clip.Resample(sample_rate, m_importSettings.resample_tolerance, m_importSettings.resample_rotation_tolerance, &max_error, &max_rotation_error))
+                    std::cout << "Resampled animation " << current_animation->mName.data << " at " << sample_rate << " Hz (max error " << max_error << ", rotation " << max_rotation_error << " rad)" << std::endl;
+                else
+                    std::cout << "ERROR::Resampling animation " << current_animation->mName.data << " exceeds tolerance (max error " << max_error << ", rotation " << max_rotation_error << " rad), keeping keyframes" << std::endl;
+            }
+
+            // Remove keyframes of tracks that never change
+            int removed_keys = new_animation_clip.EliminateStaticTracks(m_skeleton);
+            std::cout << "Removed " << removed_keys << " static keyframes from animation " << current_animation->mName.data << std::endl;
+
+            // Optionally quantize the remaining keyframes, sampling decompresses them on the fly
+            if (m_importSettings.compression_tolerance > 0.0f)
+            {
+                const size_t uncompressed_size = new_animation_clip.GetKeyframeMemory();
+                const float max_error = new_animation_clip.Compress(m_skeleton, m_importSettings.compression_tolerance);
+                std::cout << "Compressed animation " << current_animation->mName.data << " from " << uncompressed_size << " to " << new_animation_clip.GetKeyframeMemory() << " bytes (max error " << max_error << ")" << std::endl;
             }
 
-            AnimationClip new_animation_clip = AnimationClip(std::string(current_animation->mName.data), this->m_bones.size(), max_frames, current_animation->mDuration / current_animation->mTicksPerSecond, current_animation->mTicksPerSecond, poses);
+            // Cubic sampling evaluates one polynomial per segment, and SQUAD with precomputed controls for rotations
+            new_animation_clip.PrecomputeCubicSegments();
+
             m_animations.push_back(new_animation_clip);
         }
     }
@@ -312,6 +387,8 @@ void Mesh::Parse(const aiMesh* mesh, const aiScene* scene)
         else
             vert.texCoords = glm::vec2(0.0f, 0.0f);
         vertices.push_back(vert);
+
+        m_boundingRadius = std::max(m_boundingRadius, glm::length(vert.position));
     }
 
     // Parse textures
@@ -366,6 +443,7 @@ void Mesh::ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, const aiM
             //boneInfoMap[boneName] = boneCount;
             boneInfoMap.insert({ boneName, boneCount });
             m_bones.push_back(newBoneInfo);
+            m_boneInfluence.push_back(0.0f);
             boneId = boneCount;
             boneCount++;
         }
@@ -383,7 +461,57 @@ void Mesh::ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, const aiM
             float weight = weights[weightIndex].mWeight;
             assert(vertexId <= vertices.size());
             SetVertexBoneData(vertices[vertexId], boneId, weight);
+            m_boneInfluence[boneId] += weight;
+        }
+    }
+
+    // Influences past MAXIMUM_BONES are dropped and exporters do not always normalize, so the kept weights are scaled
+    // to sum to 1. The CPU skinning and the quantized GPU weights then skin with the same weights
+    for (Vertex& vertex : vertices)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < MAXIMUM_BONES; i++)
+            sum += vertex.weights[i];
+
+        if (sum > 0.0f)
+            for (int i = 0; i < MAXIMUM_BONES; i++)
+                vertex.weights[i] /= sum;
+    }
+}
+
+void Mesh::BuildJointLOD()
+{
+    const int joint_count = m_skeleton.GetJointCount();
+
+    // Sum the weights of every subtree, children come after their parents so a reverse loop visits them first
+    std::vector<float> subtree_influence(joint_count, 0.0f);
+    float total_influence = 0.0f;
+    for (int joint = joint_count - 1; joint >= 0; joint--)
+    {
+        const int bone_id = m_skeleton.bone_ids[joint];
+        if (bone_id >= 0)
+        {
+            subtree_influence[joint] += m_boneInfluence[bone_id];
+            total_influence += m_boneInfluence[bone_id];
         }
+
+        const int parent = m_skeleton.parents[joint];
+        if (parent >= 0)
+            subtree_influence[parent] += subtree_influence[joint];
+    }
+
+    // Without skin weights every joint is always animated
+    m_jointLOD.assign(joint_count, MAX_ANIMATION_LOD);
+    if (total_influence <= 0.0f)
+        return;
+
+    for (int joint = 0; joint < joint_count; joint++)
+    {
+        const float influence = subtree_influence[joint] / total_influence;
+        if (influence < LOD_HALF_MIN_INFLUENCE)
+            m_jointLOD[joint] = 0;
+        else if (influence < LOD_QUARTER_MIN_INFLUENCE)
+            m_jointLOD[joint] = 1;
     }
 }
 
@@ -509,526 +637,329 @@ void Mesh::ChangeShader(Shader* new_shader)
     m_subMeshes[0]->shader = new_shader;
 }
 
-void Mesh::Animate(int frame, std::vector<glm::vec3>* boneVertices)
+template <typename Sampler, typename Output>
+void Mesh::Animate(double m_currentTime, std::vector<glm::vec3>* boneVertices, std::vector<int>* keyCursors)
 {
     // TODO: Switching between animations can be added!
+    EvaluatePipeline<Sampler, Output>(m_pose, m_animations.back(), m_currentTime, keyCursors, 0, boneVertices);
 
-    std::vector<glm::mat4> bone_transforms;                     // Vector to be passed to vertex shader, containing all bone transforms
-
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
-
-    // Traverse nodes from root node
-    TraverseNode(frame, scene->mRootNode, initial_matrix, boneVertices);
-
-    bone_transforms.resize(m_boneCounter);
-
-    // Traverse updated bones
-    for (int i = 0; i < m_boneCounter; i++)
-    {
-        bone_transforms[i] = m_bones[i].bone_transform;
-    }
-
-    shader->use();
-
-    // Write bone transforms to vertex shader
-    shader->setMat4Vector("boneTransforms", bone_transforms);
+    UploadPose(m_pose, Output::skinning);
 }
 
-void Mesh::AnimateLI(double m_currentTime, std::vector<glm::vec3>* boneVertices)
+template <typename Sampler, typename Output>
+void Mesh::EvaluatePipeline(PoseBuffer& pose, const AnimationClip& clip, double m_currentTime, std::vector<int>* keyCursors, int lod, std::vector<glm::vec3>* boneVertices) const
 {
-    // TODO: Switching between animations can be added!
-
-    std::vector<glm::mat4> bone_transforms;                     // Vector to be passed to vertex shader, containing all bone transforms
-
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
-
-    // Traverse nodes from root node
-    TraverseNodeLI(m_currentTime, scene->mRootNode, initial_matrix, boneVertices);
+    // Sample SQTs and concatenate them down the skeleton, DQ skinning never builds matrices
+    PreparePose(pose);
+    clip.Evaluate<Sampler>(m_currentTime, pose.sampled_pose, keyCursors, m_jointLOD.data(), lod);
 
-    bone_transforms.resize(m_boneCounter);
-
-    // Traverse updated bones
-    for (int i = 0; i < m_boneCounter; i++)
+    // Output is a compile time constant, only one of the paths is compiled into each instantiation
+    if (Output::dual_quat)
     {
-        bone_transforms[i] = m_bones[i].bone_transform;
+        ComputeDualQuatPose(pose, boneVertices, Output::scale);
+        return;
     }
 
-    shader->use();
-
-    // Write bone transforms to vertex shader
-    shader->setMat4Vector("boneTransforms", bone_transforms);
+    ComposeLocalPose(pose);
+    ComputeGlobalPose(pose, boneVertices);
 }
 
-void Mesh::AnimateCI(double m_currentTime, std::vector<glm::vec3>* boneVertices)
+// Every combination of the policies of PosePipeline.hpp
+#define INSTANTIATE_POSE_PIPELINE(Sampler, Output) \
+    template void Mesh::Animate<Sampler, Output>(double, std::vector<glm::vec3>*, std::vector<int>*); \
+    template void Mesh::EvaluatePipeline<Sampler, Output>(PoseBuffer&, const AnimationClip&, double, std::vector<int>*, int, std::vector<glm::vec3>*) const;
+
+INSTANTIATE_POSE_PIPELINE(StepSampler, MatrixOutput)
+INSTANTIATE_POSE_PIPELINE(StepSampler, DualQuatOutput)
+INSTANTIATE_POSE_PIPELINE(StepSampler, ScaledDualQuatOutput)
+INSTANTIATE_POSE_PIPELINE(LinearSampler, MatrixOutput)
+INSTANTIATE_POSE_PIPELINE(LinearSampler, DualQuatOutput)
+INSTANTIATE_POSE_PIPELINE(LinearSampler, ScaledDualQuatOutput)
+INSTANTIATE_POSE_PIPELINE(CubicSampler, MatrixOutput)
+INSTANTIATE_POSE_PIPELINE(CubicSampler, DualQuatOutput)
+INSTANTIATE_POSE_PIPELINE(CubicSampler, ScaledDualQuatOutput)
+
+#undef INSTANTIATE_POSE_PIPELINE
+
+// Picks the output policy of the skinning mode, for a sampler policy that is already chosen
+template <typename Sampler>
+static void EvaluateSkinningPipeline(const Mesh& mesh, PoseBuffer& pose, const AnimationClip& clip, double m_currentTime, Skinning_Mode skinning, std::vector<int>* keyCursors, int lod)
 {
-    // TODO: Switching between animations can be added!
-
-    std::vector<glm::mat4> bone_transforms;                     // Vector to be passed to vertex shader, containing all bone transforms
-
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
-
-    // Traverse nodes from root node
-    TraverseNodeCI(m_currentTime, scene->mRootNode, initial_matrix, boneVertices);
-
-    bone_transforms.resize(m_boneCounter);
-
-    // Traverse updated bones
-    for (int i = 0; i < m_boneCounter; i++)
+    switch (skinning)
     {
-        bone_transforms[i] = m_bones[i].bone_transform;
+    case SKINNING_DUAL_QUAT:
+        mesh.EvaluatePipeline<Sampler, DualQuatOutput>(pose, clip, m_currentTime, keyCursors, lod, &pose.bone_vertices);
+        break;
+    case SKINNING_SCALED_DUAL_QUAT:
+        mesh.EvaluatePipeline<Sampler, ScaledDualQuatOutput>(pose, clip, m_currentTime, keyCursors, lod, &pose.bone_vertices);
+        break;
+    default:
+        mesh.EvaluatePipeline<Sampler, MatrixOutput>(pose, clip, m_currentTime, keyCursors, lod, &pose.bone_vertices);
+        break;
     }
-
-    shader->use();
-
-    // Write bone transforms to vertex shader
-    shader->setMat4Vector("boneTransforms", bone_transforms);
 }
 
-void Mesh::AnimateDualQuat(int frame, std::vector<glm::vec3>* boneVertices)
+void Mesh::EvaluatePose(PoseBuffer& pose, const AnimationClip& clip, double m_currentTime, Interpolation_Mode interpolation, Skinning_Mode skinning, std::vector<int>* keyCursors, int lod) const
 {
-    std::vector<glm::mat4x2> bone_transforms;
-    std::vector<glm::mat4> scale_transforms;
-
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
+    pose.bone_vertices.clear();
 
-    // Traverse nodes from root node
-    TraverseNode(frame, scene->mRootNode, initial_matrix, boneVertices);
-
-    bone_transforms.resize(m_boneCounter);
-    scale_transforms.resize(m_boneCounter);
-
-    // Traverse updated bones and convert to dual quaternions
-    for (int i = 0; i < m_boneCounter; i++)
+    // Pick the specialized pipeline once per pose instead of branching per joint
+    switch (interpolation)
     {
-        glm::quat r_quat;
-        glm::vec3 t, s;
-
-        r_quat = glm::quat_cast(m_bones[i].bone_transform);                 // Get rotation quaternion
-        t = glm::vec3(m_bones[i].bone_transform[3]);                        // Get translation from matrix
-
-        glm::quat t_quat = glm::quat(0, t.x, t.y, t.z) * r_quat * 0.5f;     // Convert translation to quaternion
-
-        // Set dual quaternion data (glm is column-major)
-        glm::mat4x2 dual_quat(0.0f);
-        dual_quat[0][0] = r_quat.w;
-        dual_quat[1][0] = r_quat.x;
-        dual_quat[2][0] = r_quat.y;
-        dual_quat[3][0] = r_quat.z;
-
-        dual_quat[0][1] = t_quat.w;
-        dual_quat[1][1] = t_quat.x;
-        dual_quat[2][1] = t_quat.y;
-        dual_quat[3][1] = t_quat.z;
-
-        /*dual_quat[0][0] = r_quat.x;
-        dual_quat[1][0] = r_quat.y;
-        dual_quat[2][0] = r_quat.z;
-        dual_quat[3][0] = r_quat.w;
-
-        dual_quat[0][1] = t_quat.x;
-        dual_quat[1][1] = t_quat.y;
-        dual_quat[2][1] = t_quat.z;
-        dual_quat[3][1] = t_quat.w;*/
-
-        bone_transforms[i] = dual_quat;
-
-        // Set Mat4
-        s.x = glm::length(m_bones[i].bone_transform[0]);
-        s.y = glm::length(m_bones[i].bone_transform[1]);
-        s.z = glm::length(m_bones[i].bone_transform[2]);
-
-        glm::mat4 scale_mat(0.0f);
-        scale_mat[0][0] = s.x;
-        scale_mat[1][1] = s.y;
-        scale_mat[2][2] = s.z;
-        scale_mat[3][3] = 1.0f;
-
-        scale_transforms[i] = scale_mat * m_bones[i].offsetMatrix;
+    case INTERPOLATION_STEP:
+        EvaluateSkinningPipeline<StepSampler>(*this, pose, clip, m_currentTime, skinning, keyCursors, lod);
+        break;
+    case INTERPOLATION_CUBIC:
+        EvaluateSkinningPipeline<CubicSampler>(*this, pose, clip, m_currentTime, skinning, keyCursors, lod);
+        break;
+    default:
+        EvaluateSkinningPipeline<LinearSampler>(*this, pose, clip, m_currentTime, skinning, keyCursors, lod);
+        break;
     }
-
-    shader->use();
-
-    // Write bone transforms to vertex shader
-    shader->setMat4x2Vector("boneTransforms", bone_transforms);
-    //shader->setMat4Vector("scaleTransforms", scale_transforms);
 }
 
-void Mesh::AnimateLIDualQuat(double m_currentTime, std::vector<glm::vec3>* boneVertices)
+void Mesh::EvaluateLocalPose(PoseBuffer& pose, const std::vector<SQT>& local, Skinning_Mode skinning) const
 {
-    std::vector<glm::mat4x2> bone_transforms;
-    std::vector<glm::mat4> scale_transforms;
+    PreparePose(pose);
+    pose.bone_vertices.clear();
 
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
-
-    // Traverse nodes from root node
-    TraverseNodeLI(m_currentTime, scene->mRootNode, initial_matrix, boneVertices);
-
-    bone_transforms.resize(m_boneCounter);
-    scale_transforms.resize(m_boneCounter);
-
-    // Traverse updated bones and convert to dual quaternions
-    for (int i = 0; i < m_boneCounter; i++)
+    if (IsDualQuatSkinning(skinning))
     {
-        glm::quat r_quat;
-        glm::vec3 t, s;
-
-        r_quat = glm::quat_cast(m_bones[i].bone_transform);                 // Get rotation quaternion
-        t = glm::vec3(m_bones[i].bone_transform[3]);                        // Get translation from matrix
-
-        glm::quat t_quat = glm::quat(0, t.x, t.y, t.z) * r_quat * 0.5f;     // Convert translation to quaternion
-
-        // Set dual quaternion data (glm is column-major)
-        glm::mat4x2 dual_quat(0.0f);
-        dual_quat[0][0] = r_quat.w;
-        dual_quat[1][0] = r_quat.x;
-        dual_quat[2][0] = r_quat.y;
-        dual_quat[3][0] = r_quat.z;
-
-        dual_quat[0][1] = t_quat.w;
-        dual_quat[1][1] = t_quat.x;
-        dual_quat[2][1] = t_quat.y;
-        dual_quat[3][1] = t_quat.z;
-
-        /*dual_quat[0][0] = r_quat.x;
-        dual_quat[1][0] = r_quat.y;
-        dual_quat[2][0] = r_quat.z;
-        dual_quat[3][0] = r_quat.w;
-
-        dual_quat[0][1] = t_quat.x;
-        dual_quat[1][1] = t_quat.y;
-        dual_quat[2][1] = t_quat.z;
-        dual_quat[3][1] = t_quat.w;*/
-
-        bone_transforms[i] = dual_quat;
-
-        // Set Mat4
-        s.x = glm::length(m_bones[i].bone_transform[0]);
-        s.y = glm::length(m_bones[i].bone_transform[1]);
-        s.z = glm::length(m_bones[i].bone_transform[2]);
-
-        glm::mat4 scale_mat(0.0f);
-        scale_mat[0][0] = s.x;
-        scale_mat[1][1] = s.y;
-        scale_mat[2][2] = s.z;
-        scale_mat[3][3] = 1.0f;
-
-        scale_transforms[i] = scale_mat;
+        ConcatenateDualQuats(pose, local.data(), &pose.bone_vertices, skinning == SKINNING_SCALED_DUAL_QUAT);
+        return;
     }
 
-    shader->use();
+    // Every joint is (potentially) blended, so all of them are composed
+    pose.sampled_pose.Clear();
+    for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
+        pose.sampled_pose.Add(joint, local[joint].translation, local[joint].rotation, local[joint].scale);
 
-    // Write bone transforms to vertex shader
-    shader->setMat4x2Vector("boneTransforms", bone_transforms);
-    //shader->setMat4Vector("scaleTransforms", scale_transforms);
+    ComposeAffineTransforms(pose.sampled_pose, pose.local_pose.data());
+    ComputeGlobalPose(pose, &pose.bone_vertices);
 }
 
-void Mesh::AnimateCIDualQuat(double m_currentTime, std::vector<glm::vec3>* boneVertices)
+bool Mesh::UploadPose(const PoseBuffer& pose, Skinning_Mode skinning) const
 {
-    std::vector<glm::mat4x2> bone_transforms;
-    std::vector<glm::mat4> scale_transforms;
-
-    glm::mat4 initial_matrix = glm::mat4(1.0f);
+    // The binding still points at this palette in the current frame, e.g. consecutive instances sharing a pose
+    if (pose.revision == m_uploadedRevision && skinning == m_uploadedSkinning && paletteRing.GetFrame() == m_uploadedFrame)
+        return true;
 
-    // Traverse nodes from root node
-    TraverseNodeCI(m_currentTime, scene->mRootNode, initial_matrix, boneVertices);
+    // Write bone transforms to the ring, the shaders read them from the bound range
+    GLintptr offset;
+    if (IsDualQuatSkinning(skinning))
+        offset = paletteRing.Upload(BONE_PALETTE_BINDING, pose.dual_quats.data(), sizeof(glm::mat4x2) * pose.dual_quats.size());
+    else
+        offset = paletteRing.Upload(BONE_PALETTE_BINDING, pose.palette.data(), sizeof(AffineTransform) * pose.palette.size());
 
-    bone_transforms.resize(m_boneCounter);
-    scale_transforms.resize(m_boneCounter);
+    // The bindings still hold the palette of an earlier draw, which must not be reused
+    if (offset < 0)
+        return false;
 
-    // Traverse updated bones and convert to dual quaternions
-    for (int i = 0; i < m_boneCounter; i++)
+    // The scale-aware shader applies the bone scales before the dual quaternions
+    if (skinning == SKINNING_SCALED_DUAL_QUAT)
     {
-        glm::quat r_quat;
-        glm::vec3 t, s;
-
-        r_quat = glm::quat_cast(m_bones[i].bone_transform);                 // Get rotation quaternion
-        t = glm::vec3(m_bones[i].bone_transform[3]);                        // Get translation from matrix
-
-        glm::quat t_quat = glm::quat(0, t.x, t.y, t.z) * r_quat * 0.5f;     // Convert translation to quaternion
-
-        // Set dual quaternion data (glm is column-major)
-        glm::mat4x2 dual_quat(0.0f);
-        dual_quat[0][0] = r_quat.w;
-        dual_quat[1][0] = r_quat.x;
-        dual_quat[2][0] = r_quat.y;
-        dual_quat[3][0] = r_quat.z;
-
-        dual_quat[0][1] = t_quat.w;
-        dual_quat[1][1] = t_quat.x;
-        dual_quat[2][1] = t_quat.y;
-        dual_quat[3][1] = t_quat.z;
-
-        /*dual_quat[0][0] = r_quat.x;
-        dual_quat[1][0] = r_quat.y;
-        dual_quat[2][0] = r_quat.z;
-        dual_quat[3][0] = r_quat.w;
-
-        dual_quat[0][1] = t_quat.x;
-        dual_quat[1][1] = t_quat.y;
-        dual_quat[2][1] = t_quat.z;
-        dual_quat[3][1] = t_quat.w;*/
-
-        bone_transforms[i] = dual_quat;
-
-        // Set Mat4
-        s.x = glm::length(m_bones[i].bone_transform[0]);
-        s.y = glm::length(m_bones[i].bone_transform[1]);
-        s.z = glm::length(m_bones[i].bone_transform[2]);
-
-        glm::mat4 scale_mat(0.0f);
-        scale_mat[0][0] = s.x;
-        scale_mat[1][1] = s.y;
-        scale_mat[2][2] = s.z;
-        scale_mat[3][3] = 1.0f;
-
-        scale_transforms[i] = scale_mat * m_bones[i].offsetMatrix;
+        offset = paletteRing.Upload(BONE_SCALE_BINDING, pose.scale_transforms.data(), sizeof(glm::mat4) * pose.scale_transforms.size());
+        if (offset < 0)
+            return false;
     }
 
-    shader->use();
-
-    // Write bone transforms to vertex shader
-    shader->setMat4x2Vector("boneTransforms", bone_transforms);
-    //shader->setMat4Vector("scaleTransforms", scale_transforms);
+    m_uploadedRevision = pose.revision;
+    m_uploadedFrame = paletteRing.GetFrame();
+    m_uploadedSkinning = skinning;
+    return true;
 }
 
-void Mesh::TraverseNode(const int frame, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices)
+void Mesh::BakeAnimation(int index, float rate, Interpolation_Mode interpolation)
 {
-    std::string node_name(std::string(node->mName.data));
-    glm::mat4 node_transform = ConvertMatrixToGLMFormat(node->mTransformation);
-
-    // Get SQT
-    SQT sqt;
-    auto sqt_it = m_animations.back().poseSamples.find(node_name);
-    if (sqt_it != m_animations.back().poseSamples.end())
+    if (index < 0 || index >= static_cast<int>(m_animations.size()) || rate <= 0.0f)
     {
-        // Check if keyframe exists
-        if (frame < sqt_it->second.bonePoses.size())
-        {
-            sqt = sqt_it->second.bonePoses[frame];
-
-            glm::mat4 scale_matrix = glm::scale(glm::identity<glm::mat4>(), sqt.scale);
-            glm::mat4 rotation_matrix = glm::toMat4(sqt.rotation);
-            glm::mat4 translation_matrix = glm::translate(glm::identity<glm::mat4>(), sqt.translation);
-
-            node_transform = translation_matrix * rotation_matrix * scale_matrix;
-        }
+        std::cout << "ERROR::Cannot bake animation " << index << " of mesh!" << std::endl;
+        return;
     }
 
-    // Combine with parent
-    glm::mat4 global_transformation = parent_transform * node_transform;
-
-    // Get Bone
-    auto bone_it = bone_map.find(node_name);
-    if (bone_it != bone_map.end())
+    const AnimationClip& clip = m_animations[index];
+    m_bakedAnimations.resize(m_animations.size());
+
+    BakedAnimation& baked = m_bakedAnimations[index];
+    baked.rate = rate;
+    baked.interpolation = interpolation;
+    baked.frame_count = glm::max(static_cast<int>(std::ceil(clip.duration * rate - 1e-3)) + 1, 2);
+    baked.bone_count = static_cast<int>(m_bones.size());
+    baked.palettes.resize(static_cast<size_t>(baked.frame_count) * baked.bone_count);
+    baked.dual_quats.resize(static_cast<size_t>(baked.frame_count) * baked.bone_count);
+    baked.scale_transforms.resize(static_cast<size_t>(baked.frame_count) * baked.bone_count);
+    baked.bone_vertices.clear();
+
+    // Sample all frames in a single pass over the clip
+    std::vector<double> times(baked.frame_count);
+    for (int frame = 0; frame < baked.frame_count; frame++)
+        times[frame] = glm::min(frame / static_cast<double>(rate), clip.duration);
+
+    std::vector<SQTBatch> sampled_frames(baked.frame_count);
+    clip.Evaluate(times.data(), baked.frame_count, interpolation, sampled_frames.data());
+
+    // Evaluate every frame with the regular pipeline
+    PoseBuffer pose;
+    PreparePose(pose);
+    for (int frame = 0; frame < baked.frame_count; frame++)
     {
-        m_bones[bone_it->second].bone_transform = inverse_transform * global_transformation * m_bones[bone_it->second].offsetMatrix;
-
-        if (node->mParent) {
-            // If node has a parent, add a visible connection from the parent to the node by placing bone vertices at the joint locations.
-            glm::vec4 bonePositionParent = parent_transform * glm::vec4(0, 0, 0, 1);
-            glm::vec4 bonePosition = global_transformation * glm::vec4(0, 0, 0, 1);
-
-            boneVertices->push_back(glm::vec3(bonePositionParent.x, bonePositionParent.y, bonePositionParent.z));
-            boneVertices->push_back(glm::vec3(bonePosition.x, bonePosition.y, bonePosition.z));
-        }
+        // All skinning modes are baked from the same samples
+        pose.sampled_pose = sampled_frames[frame];
+        ComposeLocalPose(pose);
+
+        pose.bone_vertices.clear();
+        ComputeGlobalPose(pose, &pose.bone_vertices);
+        ComputeDualQuatPose(pose, nullptr, true);
+
+        std::copy(pose.palette.begin(), pose.palette.end(), baked.palettes.begin() + static_cast<size_t>(frame) * baked.bone_count);
+        std::copy(pose.dual_quats.begin(), pose.dual_quats.end(), baked.dual_quats.begin() + static_cast<size_t>(frame) * baked.bone_count);
+        std::copy(pose.scale_transforms.begin(), pose.scale_transforms.end(), baked.scale_transforms.begin() + static_cast<size_t>(frame) * baked.bone_count);
+        baked.bone_vertices.insert(baked.bone_vertices.end(), pose.bone_vertices.begin(), pose.bone_vertices.end());
     }
+    baked.vertex_count = static_cast<int>(pose.bone_vertices.size());
+}
 
-    // Recursion to traverse all nodes
-    for (int i = 0; i < node->mNumChildren; i++)
+void Mesh::BakeAnimations(float rate, Interpolation_Mode interpolation)
+{
+    for (int index = 0; index < static_cast<int>(m_animations.size()); index++)
     {
-        TraverseNode(frame, node->mChildren[i], global_transformation, boneVertices);
+        const bool baked = index < static_cast<int>(m_bakedAnimations.size()) && m_bakedAnimations[index].IsBaked();
+        if (!baked || m_bakedAnimations[index].rate != rate || m_bakedAnimations[index].interpolation != interpolation)
+            BakeAnimation(index, rate, interpolation);
     }
 }
 
-void Mesh::TraverseNodeLI(const double m_currentTime, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices)
+bool Mesh::IsAnimationBaked(int index, Interpolation_Mode interpolation) const
 {
-    std::string node_name(std::string(node->mName.data));
-    glm::mat4 node_transform = ConvertMatrixToGLMFormat(node->mTransformation);
-
-    // Get SQT
-    SQT sqt;
-    auto sqt_it = m_animations.back().poseSamples.find(node_name);
-    if (sqt_it != m_animations.back().poseSamples.end())
-    {
-        const std::vector<SQT>& bonePoses = sqt_it->second.bonePoses;
-        const int numFrames = static_cast<int>(bonePoses.size());
-
-        // Check if keyframes exist
-        if (numFrames > 0)
-        {
-            // Look for first keyframe
-            int frame_index = 0;
-            for (int i = 0; i < bonePoses.size() - 1; i++)
-            {
+    return index >= 0 && index < static_cast<int>(m_bakedAnimations.size()) && m_bakedAnimations[index].IsBaked() && m_bakedAnimations[index].interpolation == interpolation;
+}
 
-                if (bonePoses[i].time <= m_currentTime && m_currentTime < bonePoses[i + 1].time)
-                    frame_index = i;
-            }
+void Mesh::EvaluateBakedPose(PoseBuffer& pose, int index, double m_currentTime, Skinning_Mode skinning) const
+{
+    const BakedAnimation& baked = m_bakedAnimations[index];
 
-            // Find frames
-            int nextFrameIndex = frame_index + 1;
+    PreparePose(pose);
 
-            const SQT& currentFrameSQT = bonePoses[frame_index];
-            const SQT& nextFrameSQT = bonePoses[nextFrameIndex];
+    // Find the two baked frames around the current time
+    const float frame = glm::max(static_cast<float>(m_currentTime) * baked.rate, 0.0f);
+    const int current_frame = glm::min(static_cast<int>(frame), baked.frame_count - 2);
+    const float t = glm::clamp(frame - static_cast<float>(current_frame), 0.0f, 1.0f);
 
-            // Calculate the interpolation factor
-            float t = (m_currentTime - currentFrameSQT.time) / (nextFrameSQT.time - currentFrameSQT.time);
+    const size_t bone_offset = static_cast<size_t>(current_frame) * baked.bone_count;
+    const size_t vertex_offset = static_cast<size_t>(current_frame) * baked.vertex_count;
 
-            // Interpolate scale, rotation and translation
-            glm::vec3 scale = currentFrameSQT.scale + t * (nextFrameSQT.scale - currentFrameSQT.scale);
-            glm::quat rotation = glm::normalize(glm::slerp(currentFrameSQT.rotation, nextFrameSQT.rotation, t));                    // SLERP IS THE WAY!
-            glm::vec3 translation = currentFrameSQT.translation + t * (nextFrameSQT.translation - currentFrameSQT.translation);
+    const PaletteFrame baked_frame = { &baked.palettes[bone_offset], &baked.dual_quats[bone_offset], &baked.scale_transforms[bone_offset], baked.bone_vertices.data() + vertex_offset };
+    const PaletteFrame next_baked_frame = { baked_frame.palette + baked.bone_count, baked_frame.dual_quats + baked.bone_count, baked_frame.scale_transforms + baked.bone_count, baked_frame.bone_vertices + baked.vertex_count };
 
-            // Add them to the matrices
-            glm::mat4 scale_matrix = glm::scale(glm::mat4(1.0f), scale);
-            glm::mat4 rotation_matrix = glm::toMat4(rotation);
-            glm::mat4 translation_matrix = glm::translate(glm::mat4(1.0f), translation);
+    BlendPalettes(baked_frame, next_baked_frame, baked.bone_count, baked.vertex_count, t, skinning, pose);
+}
 
-            node_transform = translation_matrix * rotation_matrix * scale_matrix;
-        }
-    }
+void Mesh::PreparePose(PoseBuffer& pose) const
+{
+    if (pose.local_pose.size() == static_cast<size_t>(m_skeleton.GetJointCount()) && pose.palette.size() == m_bones.size())
+        return;
 
-    // Combine with parent
-    glm::mat4 global_transformation = parent_transform * node_transform;
+    pose.local_pose.resize(m_skeleton.GetJointCount());
+    pose.global_pose.resize(m_skeleton.GetJointCount());
+    pose.local_sqts.resize(m_skeleton.GetJointCount());
+    pose.global_sqts.resize(m_skeleton.GetJointCount());
+    pose.palette.resize(m_bones.size());
+    pose.dual_quats.assign(m_bones.size(), glm::mat4x2(0.0f));
+    pose.scale_transforms.assign(m_bones.size(), glm::mat4(1.0f));
+}
 
-    // Get Bone
-    auto bone_it = bone_map.find(node_name);
-    if (bone_it != bone_map.end())
-    {
-        m_bones[bone_it->second].bone_transform = inverse_transform * global_transformation * m_bones[bone_it->second].offsetMatrix;
+void Mesh::ComposeLocalPose(PoseBuffer& pose) const
+{
+    // Start from the bind pose, animated joints are overwritten
+    std::copy(m_skeleton.local_bind.begin(), m_skeleton.local_bind.end(), pose.local_pose.begin());
 
-        if (node->mParent) {
-            // If node has a parent, add a visible connection from the parent to the node by placing bone vertices at the joint locations.
-            glm::vec4 bonePositionParent = parent_transform * glm::vec4(0, 0, 0, 1);
-            glm::vec4 bonePosition = global_transformation * glm::vec4(0, 0, 0, 1);
+    // Convert all sampled SQTs to local transforms at once
+    ComposeAffineTransforms(pose.sampled_pose, pose.local_pose.data());
+}
 
-            boneVertices->push_back(glm::vec3(bonePositionParent.x, bonePositionParent.y, bonePositionParent.z));
-            boneVertices->push_back(glm::vec3(bonePosition.x, bonePosition.y, bonePosition.z));
-        }
-    }
+void Mesh::SampleLocalPose(const AnimationClip& clip, double m_currentTime, Interpolation_Mode interpolation, std::vector<int>* keyCursors, SQTBatch& sampled, std::vector<SQT>& local, int lod) const
+{
+    // Same specialized sampler loop as EvaluatePose, the interpolation is picked once for the whole clip
+    clip.Evaluate(m_currentTime, interpolation, sampled, keyCursors, m_jointLOD.data(), lod);
 
-    // Recursion to traverse all nodes
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    // Start from the bind pose, animated joints are overwritten
+    local.resize(m_skeleton.GetJointCount());
+    for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
     {
-        TraverseNodeLI(m_currentTime, node->mChildren[i], global_transformation, boneVertices);
+        local[joint].translation = m_skeleton.bind_translations[joint];
+        local[joint].rotation = m_skeleton.bind_rotations[joint];
+        local[joint].scale = m_skeleton.bind_scales[joint];
     }
+
+    CopySQTs(sampled, local.data());
 }
 
-void Mesh::TraverseNodeCI(const double m_currentTime, const aiNode* node, const glm::mat4& parent_transform, std::vector<glm::vec3>* boneVertices)
+void Mesh::ComputeGlobalPose(PoseBuffer& pose, std::vector<glm::vec3>* boneVertices) const
 {
-    std::string node_name(std::string(node->mName.data));
-    glm::mat4 node_transform = ConvertMatrixToGLMFormat(node->mTransformation);
+    // Concatenate down the skeleton and apply the bone offsets in a single pass
+    ConcatenatePose(m_skeleton.parents.data(), m_skeleton.bone_ids.data(), pose.local_pose.data(), m_boneOffsets.data(), m_inverseTransform, m_skeleton.GetJointCount(), pose.global_pose.data(), pose.palette.data());
+    pose.revision = NextPoseRevision();
 
-    // Get SQT
-    SQT sqt;
-    auto sqt_it = m_animations.back().poseSamples.find(node_name);
-    if (sqt_it != m_animations.back().poseSamples.end())
+    for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
     {
-        const std::vector<SQT>& bonePoses = sqt_it->second.bonePoses;
-        const int numFrames = static_cast<int>(bonePoses.size());
+        // Get Bone
+        const int bone_id = m_skeleton.bone_ids[joint];
+        if (bone_id < 0)
+            continue;
 
-        // Check if keyframes exist
-        if (numFrames > 0)
-        {
-            // Look for first keyframe
-            int frame_index = 0;
-            for (int i = 0; i < bonePoses.size() - 1; i++)
-            {
-                if (bonePoses[i].time <= m_currentTime && m_currentTime < bonePoses[i + 1].time)
-                    frame_index = i;
-            }
-
-            // Find frames
-            int prevFrameIndex = std::max(frame_index - 1, 0);
-            int nextFrameIndex = frame_index + 1;
-            int nextNextFrameIndex = std::min(frame_index + 2, numFrames - 1);
-            int nextNextNextFrameIndex = std::min(frame_index + 3, numFrames - 1);
-
-            const SQT& prevFrameSQT = bonePoses[prevFrameIndex];
-            const SQT& currentFrameSQT = bonePoses[frame_index];
-            const SQT& nextFrameSQT = bonePoses[nextFrameIndex];
-            const SQT& nextNextFrameSQT = bonePoses[nextNextFrameIndex];
-            const SQT& nextNextNextFrameSQT = bonePoses[nextNextNextFrameIndex];
-
-
-            // Calculate the interpolation factor
-            float t = static_cast<float>((m_currentTime - currentFrameSQT.time) / (nextFrameSQT.time - currentFrameSQT.time));
-
-            // Perform cubic interpolation for scale, rotation, and translation
-            glm::vec3 scale = cubicInterpolate(
-                currentFrameSQT.scale,
-                nextFrameSQT.scale,
-                nextNextFrameSQT.scale,
-                nextNextNextFrameSQT.scale,
-                t
-            );
-
-            /*glm::quat rotation = glm::normalize(cubicInterpolate(
-                currentFrameSQT.rotation,
-                nextFrameSQT.rotation,
-                nextNextFrameSQT.rotation,
-                nextNextNextFrameSQT.rotation,
-                t
-            ));*/
-            glm::quat rotation = glm::normalize(slerp(
-                currentFrameSQT.rotation,
-                nextFrameSQT.rotation,
-                t
-            ));
-
-            glm::vec3 translation = cubicInterpolate(
-                currentFrameSQT.translation,
-                nextFrameSQT.translation,
-                nextNextFrameSQT.translation,
-                nextNextNextFrameSQT.translation,
-                t
-            );
-
-            // Add them to the matrices
-            glm::mat4 scale_matrix = glm::scale(glm::mat4(1.0f), scale);
-            glm::mat4 rotation_matrix = glm::toMat4(rotation);
-            glm::mat4 translation_matrix = glm::translate(glm::mat4(1.0f), translation);
-
-            node_transform = translation_matrix * rotation_matrix * scale_matrix;
+        const int parent = m_skeleton.parents[joint];
+        if (parent >= 0) {
+            // If node has a parent, add a visible connection from the parent to the node by placing bone vertices at the joint locations.
+            boneVertices->push_back(pose.global_pose[parent].GetTranslation());
+            boneVertices->push_back(pose.global_pose[joint].GetTranslation());
         }
     }
+}
 
-    // Combine with parent
-    glm::mat4 global_transformation = parent_transform * node_transform;
-
-    // Get Bone
-    auto bone_it = bone_map.find(node_name);
-    if (bone_it != bone_map.end())
+void Mesh::ComputeDualQuatPose(PoseBuffer& pose, std::vector<glm::vec3>* boneVertices, bool scale) const
+{
+    // Start from the bind pose, animated joints are overwritten
+    for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
     {
-        m_bones[bone_it->second].bone_transform = inverse_transform * global_transformation * m_bones[bone_it->second].offsetMatrix;
+        pose.local_sqts[joint].translation = m_skeleton.bind_translations[joint];
+        pose.local_sqts[joint].rotation = m_skeleton.bind_rotations[joint];
+        pose.local_sqts[joint].scale = m_skeleton.bind_scales[joint];
+    }
+    CopySQTs(pose.sampled_pose, pose.local_sqts.data());
 
-        if (node->mParent) {
-            // If node has a parent, add a visible connection from the parent to the node by placing bone vertices at the joint locations.
-            glm::vec4 bonePositionParent = parent_transform * glm::vec4(0, 0, 0, 1);
-            glm::vec4 bonePosition = global_transformation * glm::vec4(0, 0, 0, 1);
+    ConcatenateDualQuats(pose, pose.local_sqts.data(), boneVertices, scale);
+}
 
-            boneVertices->push_back(glm::vec3(bonePositionParent.x, bonePositionParent.y, bonePositionParent.z));
-            boneVertices->push_back(glm::vec3(bonePosition.x, bonePosition.y, bonePosition.z));
-        }
-    }
+void Mesh::ConcatenateDualQuats(PoseBuffer& pose, const SQT* local, std::vector<glm::vec3>* boneVertices, bool scale) const
+{
+    ConcatenateDualQuatPose(m_skeleton.parents.data(), m_skeleton.bone_ids.data(), local, m_boneOffsetsSQT.data(), m_inverseTransformSQT, m_skeleton.GetJointCount(), pose.global_sqts.data(), pose.dual_quats.data(), scale ? pose.scale_transforms.data() : nullptr);
+    pose.revision = NextPoseRevision();
 
-    // Recursion to traverse all nodes
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    if (!boneVertices)
+        return;
+
+    // Same connections as ComputeGlobalPose, from the parent to every bone joint
+    for (int joint = 0; joint < m_skeleton.GetJointCount(); joint++)
     {
-        TraverseNodeCI(m_currentTime, node->mChildren[i], global_transformation, boneVertices);
+        const int parent = m_skeleton.parents[joint];
+        if (m_skeleton.bone_ids[joint] < 0 || parent < 0)
+            continue;
+
+        boneVertices->push_back(pose.global_sqts[parent].translation);
+        boneVertices->push_back(pose.global_sqts[joint].translation);
     }
 }
 
-AnimationClip Mesh::GetAnimation(int index)
+const AnimationClip* Mesh::GetAnimation(int index) const
 {
-    // Check that index is indeed in list
-    if (index > m_animations.size())
+    // Check that index is indeed in list, the list may also be empty
+    if (index < 0 || index >= static_cast<int>(m_animations.size()))
     {
         std::cout << "ERROR::Animation not found in animation list of mesh!" << std::endl;
-        return m_animations[0];
+        return nullptr;
     }
 
-    return m_animations[index];
+    return &m_animations[index];
 }
 
 Shader* Mesh::getShader()
@@ -1041,7 +972,7 @@ int Mesh::GetAnimationFrameNum()
     return m_animations.back().GetFrameNum();
 }
 
-bool Mesh::HasAnimations()
+bool Mesh::HasAnimations() const
 {
     if (m_animations.empty())
         return false;
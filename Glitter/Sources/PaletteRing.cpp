@@ -0,0 +1,181 @@
+#include <PaletteRing.hpp>
+
+#include <cstring>
+#include <iostream>
+
+#define PALETTE_RING_WAIT_TIMEOUT 1000000		// Nanoseconds per fence wait, waiting is retried until the GPU is done
+
+// Persistent mapping needs glBufferStorage, core in GL 4.4 and an extension before. The context is GL 4.3, so it is checked at runtime
+static bool HasBufferStorage()
+{
+	bool supported = false;
+#if defined(GL_VERSION_4_4)
+	supported = supported || GLAD_GL_VERSION_4_4;
+#endif
+#if defined(GL_ARB_buffer_storage)
+	supported = supported || GLAD_GL_ARB_buffer_storage;
+#endif
+	return supported;
+}
+
+void PaletteRing::Init(GLsizeiptr frame_size)
+{
+	Cleanup();
+
+	GLint alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0)
+		m_alignment = alignment;
+
+	// Regions start aligned, so the first palette of every frame can be bound at the region start
+	m_frameSize = (frame_size + m_alignment - 1) / m_alignment * m_alignment;
+	const GLsizeiptr buffer_size = m_frameSize * PALETTE_RING_FRAMES;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+
+	// Immutable storage can stay mapped while the GPU reads it, coherent so writes need no explicit flush
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+	if (HasBufferStorage())
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, buffer_size, nullptr, flags);
+		m_mapped = static_cast<char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, buffer_size, flags));
+
+		// Immutable storage cannot be reallocated, so the fallback needs a buffer of its own
+		if (!m_mapped)
+		{
+			std::cout << "ERROR::PALETTE_RING::Persistent mapping failed, falling back to glBufferSubData" << std::endl;
+			glDeleteBuffers(1, &m_buffer);
+			glGenBuffers(1, &m_buffer);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+		}
+	}
+#endif
+
+	if (!m_mapped)
+		glBufferData(GL_SHADER_STORAGE_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_region = 0;
+	m_offset = 0;
+	m_required = 0;
+	m_overflowReported = false;
+}
+
+void PaletteRing::Cleanup()
+{
+	for (GLsync& fence : m_fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	if (!m_buffer)
+		return;
+
+	if (m_mapped)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		m_mapped = nullptr;
+	}
+
+	glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+}
+
+void PaletteRing::BeginFrame()
+{
+	// The previous frame lost palettes, re-create the ring so a frame like it fits. Deleting the old buffer is deferred
+	// by GL until the draw calls reading it are done, and a new buffer has no region the GPU still reads
+	if (m_required > m_frameSize)
+	{
+		const GLsizeiptr frame_size = m_required > 2 * m_frameSize ? m_required : 2 * m_frameSize;
+		std::cout << "Palette ring regions grow from " << m_frameSize << " to " << frame_size << " bytes" << std::endl;
+
+		m_frame++;
+		Init(frame_size);
+		return;
+	}
+
+	m_frame++;
+	m_region = (m_region + 1) % PALETTE_RING_FRAMES;
+	m_offset = 0;
+	m_required = 0;
+
+	// The GPU is usually PALETTE_RING_FRAMES - 1 frames behind at most, so this rarely waits
+	GLsync& fence = m_fences[m_region];
+	if (!fence)
+		return;
+
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, PALETTE_RING_WAIT_TIMEOUT);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, 0, PALETTE_RING_WAIT_TIMEOUT);
+
+	if (result == GL_WAIT_FAILED)
+		std::cout << "ERROR::PALETTE_RING::Waiting for the palette fence failed!" << std::endl;
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void PaletteRing::EndFrame()
+{
+	// Nothing to protect if the frame did not write anything
+	if (m_offset == 0)
+		return;
+
+	GLsync& fence = m_fences[m_region];
+	if (fence)
+		glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr PaletteRing::Write(const void* data, GLsizeiptr size)
+{
+	// Counted even if it does not fit, so BeginFrame knows how large the next regions have to be
+	m_required = (m_required + m_alignment - 1) / m_alignment * m_alignment + size;
+
+	const GLintptr offset = (m_offset + m_alignment - 1) / m_alignment * m_alignment;
+	if (offset + size > m_frameSize)
+	{
+		if (!m_overflowReported)
+			std::cout << "ERROR::PALETTE_RING::Palettes of a frame exceed the ring region of " << m_frameSize << " bytes, the ring grows next frame!" << std::endl;
+		m_overflowReported = true;
+		return -1;
+	}
+
+	m_offset = offset + size;
+	const GLintptr buffer_offset = m_region * m_frameSize + offset;
+
+	if (m_mapped)
+	{
+		std::memcpy(m_mapped + buffer_offset, data, size);
+	}
+	else
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, buffer_offset, size, data);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	return buffer_offset;
+}
+
+void PaletteRing::Bind(GLuint binding, GLintptr offset, GLsizeiptr size) const
+{
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, m_buffer, offset, size);
+}
+
+GLintptr PaletteRing::Upload(GLuint binding, const void* data, GLsizeiptr size)
+{
+	const GLintptr offset = Write(data, size);
+	if (offset >= 0)
+		Bind(binding, offset, size);
+
+	return offset;
+}
@@ -0,0 +1,69 @@
+#include <PoseBuffer.hpp>
+
+#include <atomic>
+
+unsigned long long NextPoseRevision()
+{
+	static std::atomic<unsigned long long> next_revision(1);
+	return next_revision++;
+}
+
+void PoseSnapshot::Store(const PoseBuffer& pose, Skinning_Mode skinning)
+{
+	bone_vertices.assign(pose.bone_vertices.begin(), pose.bone_vertices.end());
+
+	// The DQ pipelines never write the matrix palette, so only the palette the mode reads is copied
+	if (IsDualQuatSkinning(skinning))
+	{
+		dual_quats.assign(pose.dual_quats.begin(), pose.dual_quats.end());
+		bone_count = static_cast<int>(dual_quats.size());
+	}
+	else
+	{
+		palette.assign(pose.palette.begin(), pose.palette.end());
+		bone_count = static_cast<int>(palette.size());
+	}
+
+	if (skinning == SKINNING_SCALED_DUAL_QUAT)
+		scale_transforms.assign(pose.scale_transforms.begin(), pose.scale_transforms.end());
+}
+
+void BlendPalettes(const PaletteFrame& frame, const PaletteFrame& next_frame, int bone_count, int vertex_count, float t, Skinning_Mode skinning, PoseBuffer& pose)
+{
+	if (!IsDualQuatSkinning(skinning))
+	{
+		pose.palette.resize(bone_count);
+
+		// Blend the matrices, the frames are close enough for a linear blend
+		for (int bone = 0; bone < bone_count; bone++)
+			for (int row = 0; row < 3; row++)
+				pose.palette[bone].rows[row] = frame.palette[bone].rows[row] + t * (next_frame.palette[bone].rows[row] - frame.palette[bone].rows[row]);
+	}
+	else
+	{
+		pose.dual_quats.resize(bone_count);
+		for (int bone = 0; bone < bone_count; bone++)
+		{
+			const glm::mat4x2& dq = frame.dual_quats[bone];
+			const glm::mat4x2& next_dq = next_frame.dual_quats[bone];
+
+			// Dual quaternion linear blending along the shortest path
+			const float real_dot = dq[0][0] * next_dq[0][0] + dq[1][0] * next_dq[1][0] + dq[2][0] * next_dq[2][0] + dq[3][0] * next_dq[3][0];
+			pose.dual_quats[bone] = (1.0f - t) * dq + (real_dot < 0.0f ? -t : t) * next_dq;
+		}
+	}
+
+	if (skinning == SKINNING_SCALED_DUAL_QUAT)
+	{
+		pose.scale_transforms.resize(bone_count);
+		for (int bone = 0; bone < bone_count; bone++)
+			pose.scale_transforms[bone] = frame.scale_transforms[bone] + t * (next_frame.scale_transforms[bone] - frame.scale_transforms[bone]);
+	}
+
+	// Skeleton rendering
+	pose.bone_vertices.resize(vertex_count);
+	for (int i = 0; i < vertex_count; i++)
+		pose.bone_vertices[i] = frame.bone_vertices[i] + t * (next_frame.bone_vertices[i] - frame.bone_vertices[i]);
+
+	pose.revision = NextPoseRevision();
+}
@@ -0,0 +1,58 @@
+#include <PoseCache.hpp>
+
+#include <cmath>
+#include <functional>
+
+size_t PoseCache::KeyHash::operator()(const Key& key) const
+{
+	size_t hash = std::hash<const void*>()(key.mesh);
+	hash = hash * 31 + std::hash<const void*>()(key.clip);
+	hash = hash * 31 + std::hash<long long>()(key.time);
+	hash = hash * 3 + static_cast<size_t>(key.interpolation);
+	hash = hash * 3 + static_cast<size_t>(key.skinning);
+	return hash * 2 + (key.baked ? 1 : 0);
+}
+
+void PoseCache::BeginFrame()
+{
+	// Clearing keeps the buckets, so a steady crowd does not allocate every frame
+	owners.clear();
+	frame_hits = 0;
+	frame_misses = 0;
+}
+
+const AnimationPlayer* PoseCache::Lookup(const AnimationPlayer& player, Interpolation_Mode interpolation, Skinning_Mode skinning)
+{
+	if (time_step <= 0.0 || !player.tgt_mesh || !player.clip)
+		return nullptr;
+
+	// Blended and reduced rate poses depend on more than the clip time
+	if (player.fade_clip || player.lod > 0)
+		return nullptr;
+	for (const AnimationLayer& layer : player.layers)
+	{
+		if (layer.weight > 0.0f)
+			return nullptr;
+	}
+
+	Key key;
+	key.mesh = player.tgt_mesh;
+	key.clip = player.clip;
+	key.time = static_cast<long long>(std::floor(player.animation_time / time_step));
+	key.interpolation = interpolation;
+	key.skinning = skinning;
+	key.baked = player.use_baked;
+
+	auto owner_it = owners.find(key);
+	if (owner_it != owners.end() && owner_it->second != &player)
+	{
+		frame_hits++;
+		total_hits++;
+		return owner_it->second;
+	}
+
+	owners[key] = &player;
+	frame_misses++;
+	total_misses++;
+	return nullptr;
+}
@@ -0,0 +1,355 @@
+#include <PoseKernels.hpp>
+
+#include <algorithm>
+
+#if defined(POSE_KERNELS_AVX)
+#include <immintrin.h>
+#elif defined(POSE_KERNELS_SSE)
+#include <emmintrin.h>
+#endif
+
+AffineTransform AffineTransform::FromMat4(const glm::mat4& matrix)
+{
+	AffineTransform transform;
+	for (int row = 0; row < 3; row++)
+		transform.rows[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+
+	return transform;
+}
+
+glm::mat4 AffineTransform::ToMat4() const
+{
+	glm::mat4 matrix(1.0f);
+	for (int row = 0; row < 3; row++)
+	{
+		matrix[0][row] = rows[row].x;
+		matrix[1][row] = rows[row].y;
+		matrix[2][row] = rows[row].z;
+		matrix[3][row] = rows[row].w;
+	}
+
+	return matrix;
+}
+
+void SQTBatch::Grow()
+{
+	const size_t capacity = joints.empty() ? 64 : joints.size() * 2;
+
+	for (int i = 0; i < 3; i++)
+	{
+		translation[i].resize(capacity);
+		scale[i].resize(capacity);
+	}
+	for (int i = 0; i < 4; i++)
+		rotation[i].resize(capacity);
+	joints.resize(capacity);
+}
+
+// Composes the rows of translation * rotation * scale for a single entry
+static void ComposeScalar(const SQTBatch& batch, int i, AffineTransform& out)
+{
+	const float x = batch.rotation[0][i], y = batch.rotation[1][i], z = batch.rotation[2][i], w = batch.rotation[3][i];
+	const float sx = batch.scale[0][i], sy = batch.scale[1][i], sz = batch.scale[2][i];
+
+	const float xx = x * x, yy = y * y, zz = z * z;
+	const float xy = x * y, xz = x * z, yz = y * z;
+	const float wx = w * x, wy = w * y, wz = w * z;
+
+	out.rows[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * sx, 2.0f * (xy - wz) * sy, 2.0f * (xz + wy) * sz, batch.translation[0][i]);
+	out.rows[1] = glm::vec4(2.0f * (xy + wz) * sx, (1.0f - 2.0f * (xx + zz)) * sy, 2.0f * (yz - wx) * sz, batch.translation[1][i]);
+	out.rows[2] = glm::vec4(2.0f * (xz - wy) * sx, 2.0f * (yz + wx) * sy, (1.0f - 2.0f * (xx + yy)) * sz, batch.translation[2][i]);
+}
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+// Lane-wise operations, so the same composition code runs on 4 (SSE) or 8 (AVX) entries at once
+static inline __m128 Load(const float* p, __m128) { return _mm_loadu_ps(p); }
+static inline __m128 Splat(float f, __m128) { return _mm_set1_ps(f); }
+static inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+static inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+
+#if defined(POSE_KERNELS_AVX)
+static inline __m256 Load(const float* p, __m256) { return _mm256_loadu_ps(p); }
+static inline __m256 Splat(float f, __m256) { return _mm256_set1_ps(f); }
+static inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+static inline __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+static inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+#endif
+
+// Composes the 12 matrix elements of the entries starting at i, one register per element
+template <typename V>
+static inline void ComposeLanes(const SQTBatch& batch, int i, V m[3][4])
+{
+	const V tag = V();
+	const V one = Splat(1.0f, tag), two = Splat(2.0f, tag);
+
+	const V x = Load(&batch.rotation[0][i], tag), y = Load(&batch.rotation[1][i], tag);
+	const V z = Load(&batch.rotation[2][i], tag), w = Load(&batch.rotation[3][i], tag);
+	const V sx = Load(&batch.scale[0][i], tag), sy = Load(&batch.scale[1][i], tag), sz = Load(&batch.scale[2][i], tag);
+
+	const V xx = Mul(x, x), yy = Mul(y, y), zz = Mul(z, z);
+	const V xy = Mul(x, y), xz = Mul(x, z), yz = Mul(y, z);
+	const V wx = Mul(w, x), wy = Mul(w, y), wz = Mul(w, z);
+
+	m[0][0] = Mul(Sub(one, Mul(two, Add(yy, zz))), sx);
+	m[0][1] = Mul(Mul(two, Sub(xy, wz)), sy);
+	m[0][2] = Mul(Mul(two, Add(xz, wy)), sz);
+
+	m[1][0] = Mul(Mul(two, Add(xy, wz)), sx);
+	m[1][1] = Mul(Sub(one, Mul(two, Add(xx, zz))), sy);
+	m[1][2] = Mul(Mul(two, Sub(yz, wx)), sz);
+
+	m[2][0] = Mul(Mul(two, Sub(xz, wy)), sx);
+	m[2][1] = Mul(Mul(two, Add(yz, wx)), sy);
+	m[2][2] = Mul(Sub(one, Mul(two, Add(xx, yy))), sz);
+
+	m[0][3] = Load(&batch.translation[0][i], tag);
+	m[1][3] = Load(&batch.translation[1][i], tag);
+	m[2][3] = Load(&batch.translation[2][i], tag);
+}
+
+// Transposes the elements of 4 entries back to rows and scatters them to their joints
+static inline void Store4(const SQTBatch& batch, int i, __m128 m[3][4], AffineTransform* transforms)
+{
+	for (int row = 0; row < 3; row++)
+	{
+		__m128 r0 = m[row][0], r1 = m[row][1], r2 = m[row][2], r3 = m[row][3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		_mm_storeu_ps(&transforms[batch.joints[i]].rows[row].x, r0);
+		_mm_storeu_ps(&transforms[batch.joints[i + 1]].rows[row].x, r1);
+		_mm_storeu_ps(&transforms[batch.joints[i + 2]].rows[row].x, r2);
+		_mm_storeu_ps(&transforms[batch.joints[i + 3]].rows[row].x, r3);
+	}
+}
+#endif
+
+void ComposeAffineTransforms(const SQTBatch& batch, AffineTransform* transforms)
+{
+	int i = 0;
+
+#if defined(POSE_KERNELS_AVX)
+	for (; i + 8 <= batch.count; i += 8)
+	{
+		__m256 m[3][4];
+		ComposeLanes(batch, i, m);
+
+		__m128 low[3][4], high[3][4];
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 4; col++)
+			{
+				low[row][col] = _mm256_castps256_ps128(m[row][col]);
+				high[row][col] = _mm256_extractf128_ps(m[row][col], 1);
+			}
+		}
+
+		Store4(batch, i, low, transforms);
+		Store4(batch, i + 4, high, transforms);
+	}
+#endif
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+	for (; i + 4 <= batch.count; i += 4)
+	{
+		__m128 m[3][4];
+		ComposeLanes(batch, i, m);
+		Store4(batch, i, m, transforms);
+	}
+#endif
+
+	// Remaining entries (or everything, without SIMD)
+	for (; i < batch.count; i++)
+		ComposeScalar(batch, i, transforms[batch.joints[i]]);
+}
+
+void CopySQTs(const SQTBatch& batch, SQT* transforms)
+{
+	for (int i = 0; i < batch.count; i++)
+	{
+		SQT& sqt = transforms[batch.joints[i]];
+		sqt.translation = glm::vec3(batch.translation[0][i], batch.translation[1][i], batch.translation[2][i]);
+		sqt.rotation = glm::quat(batch.rotation[3][i], batch.rotation[0][i], batch.rotation[1][i], batch.rotation[2][i]);
+		sqt.scale = glm::vec3(batch.scale[0][i], batch.scale[1][i], batch.scale[2][i]);
+	}
+}
+
+SQT DecomposeTransform(const glm::mat4& matrix)
+{
+	SQT sqt;
+
+	sqt.scale = glm::vec3(glm::length(matrix[0]), glm::length(matrix[1]), glm::length(matrix[2]));
+	if (glm::determinant(glm::mat3(matrix)) < 0.0f)
+		sqt.scale.x = -sqt.scale.x;
+
+	sqt.translation = glm::vec3(matrix[3]);
+	sqt.rotation = glm::normalize(glm::quat_cast(glm::mat3(glm::vec3(matrix[0]) / sqt.scale.x, glm::vec3(matrix[1]) / sqt.scale.y, glm::vec3(matrix[2]) / sqt.scale.z)));
+
+	return sqt;
+}
+
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+static inline __m128 LoadVec3(const glm::vec3& v)
+{
+	return _mm_set_ps(0.0f, v.z, v.y, v.x);
+}
+
+static inline void StoreVec3(__m128 v, glm::vec3& out)
+{
+	alignas(16) float f[4];
+	_mm_store_ps(f, v);
+	out = glm::vec3(f[0], f[1], f[2]);
+}
+
+// Cross product of the x, y, z lanes, the w lane of the result is 0
+static inline __m128 Cross(__m128 a, __m128 b)
+{
+	const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Quaternion product p * q, both stored as (x, y, z, w) like glm::quat
+static inline __m128 QuatMultiply(__m128 p, __m128 q)
+{
+	const __m128 x_signs = _mm_set_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+	const __m128 y_signs = _mm_set_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+	const __m128 z_signs = _mm_set_ps(-1.0f, 1.0f, 1.0f, -1.0f);
+
+	__m128 r = _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)), q);
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(q, q, _MM_SHUFFLE(0, 1, 2, 3))), x_signs));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(q, q, _MM_SHUFFLE(1, 0, 3, 2))), y_signs));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(q, q, _MM_SHUFFLE(2, 3, 0, 1))), z_signs));
+	return r;
+}
+#endif
+
+void MultiplySQT(const SQT& a, const SQT& b, SQT& result)
+{
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+	const __m128 a_rotation = _mm_loadu_ps(&a.rotation.x);
+	const __m128 a_scale = LoadVec3(a.scale);
+
+	// Rotate the scaled translation of b: v + 2w (q x v) + 2 q x (q x v)
+	const __m128 v = _mm_mul_ps(a_scale, LoadVec3(b.translation));
+	const __m128 t = Cross(a_rotation, _mm_add_ps(v, v));
+	const __m128 rotated = _mm_add_ps(_mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(a_rotation, a_rotation, _MM_SHUFFLE(3, 3, 3, 3)), t)), Cross(a_rotation, t));
+
+	const __m128 translation = _mm_add_ps(LoadVec3(a.translation), rotated);
+	const __m128 rotation = QuatMultiply(a_rotation, _mm_loadu_ps(&b.rotation.x));
+	const __m128 scale = _mm_mul_ps(a_scale, LoadVec3(b.scale));
+
+	// Everything is read before writing, result may alias a or b
+	_mm_storeu_ps(&result.rotation.x, rotation);
+	StoreVec3(scale, result.scale);
+	StoreVec3(translation, result.translation);
+#else
+	const glm::vec3 translation = a.translation + a.rotation * (a.scale * b.translation);
+
+	result.rotation = a.rotation * b.rotation;
+	result.scale = a.scale * b.scale;
+	result.translation = translation;
+#endif
+}
+
+void MultiplyAffine(const AffineTransform& a, const AffineTransform& b, AffineTransform& result)
+{
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+	const __m128 b0 = _mm_loadu_ps(&b.rows[0].x);
+	const __m128 b1 = _mm_loadu_ps(&b.rows[1].x);
+	const __m128 b2 = _mm_loadu_ps(&b.rows[2].x);
+	const __m128 b3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);			// Implicit last row (0, 0, 0, 1)
+
+	// Every result row is a linear combination of the rows of b
+	for (int row = 0; row < 3; row++)
+	{
+		const __m128 a_row = _mm_loadu_ps(&a.rows[row].x);
+
+		__m128 r = _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+
+		_mm_storeu_ps(&result.rows[row].x, r);
+	}
+#else
+	const glm::vec4 b3(0.0f, 0.0f, 0.0f, 1.0f);
+
+	for (int row = 0; row < 3; row++)
+	{
+		const glm::vec4 a_row = a.rows[row];
+		result.rows[row] = a_row.x * b.rows[0] + a_row.y * b.rows[1] + a_row.z * b.rows[2] + a_row.w * b3;
+	}
+#endif
+}
+
+void ConcatenatePose(const int* parents, const int* bone_ids, const AffineTransform* local, const AffineTransform* offsets, const AffineTransform& root_inverse, int joint_count, AffineTransform* global, AffineTransform* palette)
+{
+	for (int joint = 0; joint < joint_count; joint++)
+	{
+		// Parents are stored before their children, so they are already up to date
+		const int parent = parents[joint];
+		if (parent < 0)
+			global[joint] = local[joint];
+		else
+			MultiplyAffine(global[parent], local[joint], global[joint]);
+
+		const int bone_id = bone_ids[joint];
+		if (bone_id < 0)
+			continue;
+
+		AffineTransform skinning;
+		MultiplyAffine(global[joint], offsets[bone_id], skinning);
+		MultiplyAffine(root_inverse, skinning, palette[bone_id]);
+	}
+}
+
+void ConcatenateDualQuatPose(const int* parents, const int* bone_ids, const SQT* local, const SQT* offsets, const SQT& root_inverse, int joint_count, SQT* global, glm::mat4x2* dual_quats, glm::mat4* scales)
+{
+	for (int joint = 0; joint < joint_count; joint++)
+	{
+		// Parents are stored before their children, so they are already up to date
+		const int parent = parents[joint];
+		if (parent < 0)
+			global[joint] = local[joint];
+		else
+			MultiplySQT(global[parent], local[joint], global[joint]);
+
+		const int bone_id = bone_ids[joint];
+		if (bone_id < 0)
+			continue;
+
+		SQT skinning;
+		MultiplySQT(global[joint], offsets[bone_id], skinning);
+		MultiplySQT(root_inverse, skinning, skinning);
+
+		// Real part is the rotation, dual part half the translation times the rotation.
+		// glm is column-major, so both parts are interleaved as (w, w', x, x', y, y', z, z')
+		float* dual_quat = &dual_quats[bone_id][0][0];
+#if defined(POSE_KERNELS_SSE) || defined(POSE_KERNELS_AVX)
+		const __m128 real = _mm_loadu_ps(&skinning.rotation.x);
+		const __m128 dual = _mm_mul_ps(QuatMultiply(LoadVec3(skinning.translation), real), _mm_set1_ps(0.5f));
+
+		const __m128 real_wxyz = _mm_shuffle_ps(real, real, _MM_SHUFFLE(2, 1, 0, 3));
+		const __m128 dual_wxyz = _mm_shuffle_ps(dual, dual, _MM_SHUFFLE(2, 1, 0, 3));
+		_mm_storeu_ps(dual_quat, _mm_unpacklo_ps(real_wxyz, dual_wxyz));
+		_mm_storeu_ps(dual_quat + 4, _mm_unpackhi_ps(real_wxyz, dual_wxyz));
+#else
+		const glm::quat& r = skinning.rotation;
+		const glm::quat d = glm::quat(0.0f, skinning.translation.x, skinning.translation.y, skinning.translation.z) * r * 0.5f;
+
+		const float interleaved[8] = { r.w, d.w, r.x, d.x, r.y, d.y, r.z, d.z };
+		std::copy(interleaved, interleaved + 8, dual_quat);
+#endif
+
+		// The rigid part is in the dual quaternion, the scale is applied to the vertex before it
+		if (scales)
+		{
+			scales[bone_id] = glm::mat4(1.0f);
+			scales[bone_id][0][0] = skinning.scale.x;
+			scales[bone_id][1][1] = skinning.scale.y;
+			scales[bone_id][2][2] = skinning.scale.z;
+		}
+	}
+}
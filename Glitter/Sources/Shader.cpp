@@ -142,7 +142,7 @@ void Shader::setVec3(const std::string& name, const glm::vec3 vec) const
     glUniform3fv(uniform_location, 1, glm::value_ptr(vec));
 }
 
-void Shader::setMat4Vector(const std::string& name, const std::vector<glm::mat4> mat_vec) const
+void Shader::setMat4Vector(const std::string& name, const std::vector<glm::mat4>& mat_vec) const
 {
     int uniform_location = glGetUniformLocation(m_programId, name.c_str());
 
@@ -155,7 +155,7 @@ void Shader::setMat4Vector(const std::string& name, const std::vector<glm::mat4>
     glUniformMatrix4fv(uniform_location, (GLsizei)mat_vec.size(), GL_FALSE, glm::value_ptr(mat_vec[0]));
 }
 
-void Shader::setMat4x2Vector(const std::string& name, const std::vector<glm::mat4x2> mat_vec) const
+void Shader::setMat4x2Vector(const std::string& name, const std::vector<glm::mat4x2>& mat_vec) const
 {
     int uniform_location = glGetUniformLocation(m_programId, name.c_str());
 
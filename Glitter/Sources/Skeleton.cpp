@@ -0,0 +1,113 @@
+#include <Skeleton.hpp>
+
+#include <glm/gtc/type_ptr.hpp>
+
+void Skeleton::Build(const aiNode* root)
+{
+	parents.clear();
+	local_bind.clear();
+	bind_translations.clear();
+	bind_rotations.clear();
+	bind_scales.clear();
+	names.clear();
+	bone_ids.clear();
+
+	if (root)
+		AddJoint(root, -1);
+}
+
+int Skeleton::FindJoint(const std::string& name) const
+{
+	for (int i = 0; i < GetJointCount(); i++)
+	{
+		if (names[i] == name)
+			return i;
+	}
+
+	return -1;
+}
+
+void Skeleton::BuildSubtreeMask(int root, std::vector<float>& mask) const
+{
+	mask.assign(GetJointCount(), 0.0f);
+	if (root < 0 || root >= GetJointCount())
+		return;
+
+	// Parents come before their children, so a single pass reaches the whole subtree
+	mask[root] = 1.0f;
+	for (int joint = root + 1; joint < GetJointCount(); joint++)
+	{
+		if (parents[joint] >= 0 && mask[parents[joint]] > 0.0f)
+			mask[joint] = 1.0f;
+	}
+}
+
+int Skeleton::Prune()
+{
+	const int joint_count = GetJointCount();
+
+	// Children come after their parent, so a reverse pass marks all ancestors of the bones
+	std::vector<bool> needed(joint_count, false);
+	bool has_bones = false;
+	for (int joint = joint_count - 1; joint >= 0; joint--)
+	{
+		if (bone_ids[joint] >= 0)
+			needed[joint] = has_bones = true;
+		if (needed[joint] && parents[joint] >= 0)
+			needed[parents[joint]] = true;
+	}
+
+	// Without bones there is nothing to skin, keep the node hierarchy as is
+	if (!has_bones)
+		return 0;
+
+	// Compact in place, the kept joints stay in the same order so parents still come first
+	std::vector<int> new_index(joint_count, -1);
+	int kept = 0;
+	for (int joint = 0; joint < joint_count; joint++)
+	{
+		if (!needed[joint])
+			continue;
+
+		new_index[joint] = kept;
+		parents[kept] = parents[joint] >= 0 ? new_index[parents[joint]] : -1;
+		local_bind[kept] = local_bind[joint];
+		bind_translations[kept] = bind_translations[joint];
+		bind_rotations[kept] = bind_rotations[joint];
+		bind_scales[kept] = bind_scales[joint];
+		names[kept].swap(names[joint]);
+		bone_ids[kept] = bone_ids[joint];
+		kept++;
+	}
+
+	parents.resize(kept);
+	local_bind.resize(kept);
+	bind_translations.resize(kept);
+	bind_rotations.resize(kept);
+	bind_scales.resize(kept);
+	names.resize(kept);
+	bone_ids.resize(kept);
+
+	return joint_count - kept;
+}
+
+void Skeleton::AddJoint(const aiNode* node, int parent)
+{
+	int index = GetJointCount();
+
+	parents.push_back(parent);
+	const glm::mat4 bind = glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+	local_bind.push_back(AffineTransform::FromMat4(bind));
+
+	// Decompose the bind transform, so animation tracks can be compared against it
+	const SQT bind_sqt = DecomposeTransform(bind);
+	bind_translations.push_back(bind_sqt.translation);
+	bind_rotations.push_back(bind_sqt.rotation);
+	bind_scales.push_back(bind_sqt.scale);
+	names.push_back(std::string(node->mName.data));
+	bone_ids.push_back(-1);
+
+	// Depth first, so children always end up after their parent
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		AddJoint(node->mChildren[i], index);
+}
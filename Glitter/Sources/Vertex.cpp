@@ -0,0 +1,59 @@
+#include <Vertex.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+// Normalizes a direction for snorm packing, degenerate directions (e.g. missing tangents) stay zero
+static inline glm::vec3 SafeNormalize(const glm::vec3& v)
+{
+	const float length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3(0.0f);
+}
+
+PackedVertex PackVertex(const Vertex& vertex, int* dropped_influences)
+{
+	PackedVertex packed;
+	packed.position = vertex.position;
+
+	// The handedness keeps mirrored UVs correct if a shader rebuilds the bitangent
+	const glm::vec3 normal = SafeNormalize(vertex.normal);
+	const glm::vec3 tangent = SafeNormalize(vertex.tangent);
+	const float handedness = glm::dot(glm::cross(normal, tangent), vertex.biTangent) < 0.0f ? -1.0f : 1.0f;
+
+	packed.normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+	packed.tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, handedness));
+	packed.texCoords = glm::packHalf2x16(vertex.texCoords);
+
+	// Round every weight, then give the rounding error to the largest one so the quantized weights keep the sum of the
+	// float weights (1 for imported skinned vertices, see Mesh::ExtractBoneWeightForVertices)
+	float sum = 0.0f;
+	int total = 0;
+	int largest = 0;
+	for (int i = 0; i < MAXIMUM_BONES; i++)
+	{
+		// A bone ID outside the 16 bit range would wrap to another bone, the influence is dropped instead
+		if (vertex.boneIDs[i] < 0 || vertex.boneIDs[i] > MAXIMUM_PACKED_BONE_ID)
+		{
+			packed.weights[i] = 0;
+			packed.boneIDs[i] = 0;
+			if (dropped_influences && vertex.weights[i] > 0.0f)
+				(*dropped_influences)++;
+			continue;
+		}
+
+		const float clamped = glm::clamp(vertex.weights[i], 0.0f, 1.0f);
+		const int weight = static_cast<int>(clamped * 65535.0f + 0.5f);
+		packed.weights[i] = static_cast<uint16_t>(weight);
+		packed.boneIDs[i] = static_cast<uint16_t>(vertex.boneIDs[i]);
+		sum += clamped;
+		total += weight;
+
+		if (weight > packed.weights[largest])
+			largest = i;
+	}
+
+	const int target = static_cast<int>(sum * 65535.0f + 0.5f);
+	if (total > 0)
+		packed.weights[largest] = static_cast<uint16_t>(glm::clamp(packed.weights[largest] + target - total, 0, 65535));
+
+	return packed;
+}
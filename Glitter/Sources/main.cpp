@@ -8,6 +8,9 @@
 #include "GUI.hpp"
 #include <Skybox.hpp>
 #include <AnimationPlayer.hpp>
+#include <AnimationWorkerPool.hpp>
+#include <PoseCache.hpp>
+#include <CpuSkinning.hpp>
 #include "Application.hpp"
 
 // System Headers
@@ -15,9 +18,17 @@
 #include <GLFW/glfw3.h>
 
 // Standard Headers
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <glm/gtc/matrix_transform.hpp>
+
+#define INSTANCE_SPACING 2.0f           // Distance between rendered instances of the active mesh
+#define INSTANCE_TIME_OFFSET 0.25       // Animation time offset (seconds) between instances
+#define SKINNING_VALIDATION_STEPS 8     // Clip times per asset and skinning mode checked by --validate-skinning
+#define SKINNING_VALIDATION_TOLERANCE 1e-4f // Largest CPU skinning error, relative to the bounding radius of the mesh
 
 // Input Function Declarations
 void processKeyboardInput(GLFWwindow* window);
@@ -25,6 +36,9 @@ void mouseMovementCallback(GLFWwindow* window, double x_pos, double y_pos);
 void mouseScrollCallback(GLFWwindow* window, double x_offset, double y_offset);
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 
+// Validation Function Declarations
+bool validateCpuSkinning(AssetLoader& assetLoader);
+
 // Create Render Settings Globals
 static SceneSettings g_renderData =
 {
@@ -36,11 +50,17 @@ static SceneSettings g_renderData =
     false,                  // default wireframe mode
     false,                  // default bone visibility
     true,                   // default skybox rendering
-    false,                  // default dual_quaternion skinning
-    false,                  // default cubic interpolation flag
+    SKINNING_LINEAR_BLEND,  // default skinning mode
+    INTERPOLATION_LINEAR,   // default interpolation mode
+    false,                  // default baked playback flag
+    false,                  // default animation LOD flag (opt-in, reduced rate updates lag and drop joints)
+    static_cast<float>(DEFAULT_POSE_CACHE_STEP * 1000.0),   // default pose cache time step (ms)
+    1,                      // default number of instances
     1.0f,                   // default animation speed
     nullptr,                // no active asset at first
-    0                       // 0th frame is default for animation
+    0,                      // 0th frame is default for animation
+    0,                      // no pose cache hits yet
+    0                       // no pose cache misses yet
 };
 
 // Create Camera Object
@@ -52,8 +72,8 @@ static Timer g_timer;
 // First Mouse Movement Hack
 bool first_mouse_flag = true;
 
-// Animation Player
-AnimationPlayer anim_player(0, nullptr);
+// Animation Players, one per rendered instance of the active mesh. Instances share the mesh, each player has its own pose
+std::vector<AnimationPlayer> anim_players(1, AnimationPlayer(0, nullptr));
 
 // Input Tracking Globals
 bool spacebar_down = false;
@@ -138,10 +158,10 @@ int main(int argc, char* argv[])
     Shader dqScaleShader = Shader();
     dqScaleShader.init();
 
-    /*dqScaleShader
+    dqScaleShader
         .registerShader("Shaders/bone_dq_scale_shader.vert", GL_VERTEX_SHADER)
         .registerShader("Shaders/lighting_shader.frag", GL_FRAGMENT_SHADER)
-        .link();*/
+        .link();
 
     // create and link skybox shader
     Shader skyboxShader = Shader();
@@ -167,12 +187,22 @@ int main(int argc, char* argv[])
         .registerShader("Shaders/skeleton_shader.vert", GL_VERTEX_SHADER)
         .registerShader("Shaders/skeleton_shader.frag", GL_FRAGMENT_SHADER)
         .link();
+
+    // Bone palettes of all instances are streamed through one buffer, persistently mapped if the driver supports it
+    Mesh::paletteRing.Init();
+    std::cout << "Palette ring " << (Mesh::paletteRing.IsPersistent() ? "persistently mapped" : "uses glBufferSubData") << std::endl;
     
 
     // Initialize our dynamic asset loader and load fbx files from the asset folder
     AssetLoader assetLoader = AssetLoader();
     assetLoader.Load("Assets/*.fbx", boneShader);
 
+    // With --validate-skinning the CPU skinning backend is checked on every animated asset, then the application exits without rendering
+    const bool validate_skinning = argc > 1 && std::string(argv[1]) == "--validate-skinning";
+    int exit_code = EXIT_SUCCESS;
+    if (validate_skinning && !validateCpuSkinning(assetLoader))
+        exit_code = EXIT_FAILURE;
+
     // Create Floor Mesh
     Mesh floor("Assets/ca_floor.fbx", &textureShader);
 
@@ -181,13 +211,19 @@ int main(int argc, char* argv[])
     gui.Init();
 
     // Set Animation Player
-    //anim_player = AnimationPlayer(0, g_renderData.active_asset->m_mesh.get());
+    //anim_players[0] = AnimationPlayer(0, g_renderData.active_asset->m_mesh.get());
 
     // Previously selected mesh
     Mesh* previous_mesh = nullptr;
 
+    // Worker threads evaluating animated instances, the render thread only uploads their palettes
+    AnimationWorkerPool animation_workers;
+    std::vector<AnimationPlayer*> animated_instances;
+    PoseCache pose_cache;                           // Instances at the same clip time share one evaluated pose
+    unsigned long long skeleton_revision = 0;       // Pose revision of the skeleton vertices on the GPU
+
     // Rendering Loop
-    while (glfwWindowShouldClose(mWindow) == false)
+    while (!validate_skinning && glfwWindowShouldClose(mWindow) == false)
     {
         // Update Timer
         g_timer.Tick();
@@ -213,6 +249,79 @@ int main(int argc, char* argv[])
         GLuint texture_normalID = 1;
         GLuint texture_specularID = 2;
 
+        // Animation modes of this frame, chosen in the GUI
+        const Interpolation_Mode interpolation = static_cast<Interpolation_Mode>(g_renderData.interpolation_mode);
+        const Skinning_Mode skinning = static_cast<Skinning_Mode>(g_renderData.skinning_mode);
+
+        // Start evaluating animations, so the workers run while the skybox is rendered
+        animated_instances.clear();
+        if (g_renderData.active_asset)
+        {
+            Mesh* pActiveMesh = g_renderData.active_asset->m_mesh.get();
+
+            // Check if mesh selection or number of instances has changed
+            if (pActiveMesh != previous_mesh || anim_players.size() != static_cast<size_t>(g_renderData.instance_count))
+            {
+                anim_players.resize(g_renderData.instance_count, AnimationPlayer(0, nullptr));
+
+                // Update AnimationPlayers, every instance starts at a different time
+                if (pActiveMesh->HasAnimations())
+                {
+                    for (size_t i = 0; i < anim_players.size(); i++)
+                    {
+                        anim_players[i].SetValues(0, pActiveMesh);
+                        anim_players[i].animation_time = i * INSTANCE_TIME_OFFSET;
+                    }
+                }
+
+                previous_mesh = pActiveMesh;
+            }
+
+            if (pActiveMesh->HasAnimations())
+            {
+                const float tan_half_fov = std::tan(glm::radians(g_camera.fov) * 0.5f);
+
+                pose_cache.time_step = g_renderData.pose_cache_step * 0.001;
+                pose_cache.BeginFrame();
+
+                // Workers are idle here, so baking is safe. Only clips missing or baked with the other interpolation are baked
+                if (g_renderData.baked_playback_flag)
+                    pActiveMesh->BakeAnimations(DEFAULT_BAKE_RATE, interpolation);
+
+                for (size_t i = 0; i < anim_players.size(); i++)
+                {
+                    AnimationPlayer& player = anim_players[i];
+
+                    if (player.use_baked != g_renderData.baked_playback_flag)
+                        player.SetBaked(g_renderData.baked_playback_flag);
+
+                    // Distant instances are updated less often, each instance in a different frame
+                    player.lod = 0;
+                    if (g_renderData.animation_lod_flag)
+                    {
+                        const float distance = glm::length(g_camera.position - glm::vec3(i * INSTANCE_SPACING, 0.0f, 0.0f));
+                        if (distance > pActiveMesh->GetBoundingRadius())
+                            player.lod = AnimationPlayer::SelectLOD(pActiveMesh->GetBoundingRadius() / (distance * tan_half_fov));
+                    }
+                    player.lod_phase = static_cast<int>(i);
+
+                    player.UpdateTime(g_timer.GetData().DeltaTime, g_renderData.anim_speed);
+
+                    // Only the first instance at a clip time is evaluated, the others render its pose
+                    const AnimationPlayer* pose_owner = pose_cache.Lookup(player, interpolation, skinning);
+                    player.SharePose(pose_owner);
+
+                    // Paused players keep their pose (and the uploaded palette), the workers skip them
+                    if (!pose_owner && !player.IsPoseCurrent(interpolation, skinning))
+                        animated_instances.push_back(&player);
+                }
+
+                g_renderData.pose_cache_hits = static_cast<int>(pose_cache.GetFrameHits());
+                g_renderData.pose_cache_misses = static_cast<int>(pose_cache.GetFrameMisses());
+            }
+        }
+        animation_workers.Dispatch(animated_instances, interpolation, skinning);
+
         // Render Skybox
         if (g_renderData.show_skybox)
             skybox.Render(view, projection);
@@ -234,62 +343,57 @@ int main(int argc, char* argv[])
         );*/
 
         // Render Mesh
+        Mesh::paletteRing.BeginFrame();
         if (g_renderData.active_asset)
         {
             Mesh* pActiveMesh = g_renderData.active_asset->m_mesh.get();
 
-            // Check if mesh selection has changed
-            if (pActiveMesh != previous_mesh)
-            {
-                // Update AnimationPlayer
-                if (pActiveMesh->HasAnimations())
-                    anim_player.SetValues(0, pActiveMesh);
-
-                previous_mesh = pActiveMesh;
-            }
-
-            // Check whether mesh has animation and evaluate
+            // Check whether mesh has animation and wait for the evaluated poses
             if (pActiveMesh->HasAnimations())
             {
-                std::vector<glm::vec3> boneVertices = std::vector<glm::vec3>();
+                animation_workers.Wait();
 
                 // Check type of skinning
-                if (g_renderData.dual_quat_skinning_flag)
-                {
+                if (skinning == SKINNING_SCALED_DUAL_QUAT)
+                    pActiveMesh->ChangeShader(&dqScaleShader);
+                else if (skinning == SKINNING_DUAL_QUAT)
                     pActiveMesh->ChangeShader(&dqShader);
-                    if (g_renderData.cubic_interpolation_flag)
-                        pActiveMesh->AnimateCIDualQuat(anim_player.UpdateTime(g_timer.GetData().DeltaTime, g_renderData.anim_speed), &boneVertices);
-                    else
-                        pActiveMesh->AnimateLIDualQuat(anim_player.UpdateTime(g_timer.GetData().DeltaTime, g_renderData.anim_speed), &boneVertices);
-                }
                 else
-                {
                     pActiveMesh->ChangeShader(&boneShader);
-                    if (g_renderData.cubic_interpolation_flag)
-                        pActiveMesh->AnimateCI(anim_player.UpdateTime(g_timer.GetData().DeltaTime, g_renderData.anim_speed), &boneVertices);
-                    else
-                        pActiveMesh->AnimateLI(anim_player.UpdateTime(g_timer.GetData().DeltaTime, g_renderData.anim_speed), &boneVertices);
-                }
 
-                //pActiveMesh->Animate(g_renderData.animation_frame, &boneVertices);
+                //pActiveMesh->Animate<StepSampler, MatrixOutput>(anim_players[0].animation_time, &boneVertices);
 
-                Mesh::UpdateSkeletonVertices(boneVertices);
+                // Only the skeleton of the first instance is rendered, and only uploaded when its pose changed
+                const PoseBuffer& skeleton_pose = anim_players[0].GetPose();
+                if (skeleton_pose.revision != skeleton_revision)
+                {
+                    Mesh::UpdateSkeletonVertices(skeleton_pose.bone_vertices);
+                    skeleton_revision = skeleton_pose.revision;
+                }
             }
 
-            pActiveMesh->Render(
-                view,
-                glm::mat4(1.0f),
-                projection,
-                g_camera.position,
-                glm::vec3(g_renderData.light_position[0], g_renderData.light_position[1], g_renderData.light_position[2]),
-                glm::vec3(g_renderData.base_color[0], g_renderData.base_color[1], g_renderData.base_color[2]),
-                glm::vec3(g_renderData.light_color[0], g_renderData.light_color[1], g_renderData.light_color[2]),
-                g_renderData.manual_metallic,
-                g_renderData.manual_roughness,
-                texture_diffuseID,
-                texture_normalID,
-                texture_specularID
-            );
+            // Render every instance with its own pose, side by side. Consecutive instances sharing a pose upload it once.
+            // An instance whose palette did not fit into the ring this frame is skipped, the ring grows for the next frame
+            for (size_t i = 0; i < anim_players.size(); i++)
+            {
+                if (pActiveMesh->HasAnimations() && !pActiveMesh->UploadPose(anim_players[i].GetPose(), skinning))
+                    continue;
+
+                pActiveMesh->Render(
+                    view,
+                    glm::translate(glm::mat4(1.0f), glm::vec3(i * INSTANCE_SPACING, 0.0f, 0.0f)),
+                    projection,
+                    g_camera.position,
+                    glm::vec3(g_renderData.light_position[0], g_renderData.light_position[1], g_renderData.light_position[2]),
+                    glm::vec3(g_renderData.base_color[0], g_renderData.base_color[1], g_renderData.base_color[2]),
+                    glm::vec3(g_renderData.light_color[0], g_renderData.light_color[1], g_renderData.light_color[2]),
+                    g_renderData.manual_metallic,
+                    g_renderData.manual_roughness,
+                    texture_diffuseID,
+                    texture_normalID,
+                    texture_specularID
+                );
+            }
 
             if (gui.ShouldRenderBones()) {
                 // Disable depth testing so that the skeleton rendering is always on top
@@ -305,6 +409,7 @@ int main(int argc, char* argv[])
                 glEnable(GL_DEPTH_TEST);
             }
         }
+        Mesh::paletteRing.EndFrame();
         
         // Render GUI
         gui.Render();
@@ -324,10 +429,56 @@ int main(int argc, char* argv[])
     skyboxShader.cleanup();
 
     Mesh::skeletonShader.cleanup();
+    Mesh::paletteRing.Cleanup();
 
     glfwTerminate();
 
-    return EXIT_SUCCESS;
+    return exit_code;
+}
+
+// Skins every animated asset on the CPU with each skinning mode and compares it with the glm reference of the bone shaders
+bool validateCpuSkinning(AssetLoader& assetLoader)
+{
+    static const char* skinning_names[] = { "linear blend", "dual quaternion", "dual quaternion with scale" };
+
+    AnimationWorkerPool workers;
+    PoseBuffer pose;
+    SkinnedVertices skinned;
+    bool valid = true;
+
+    for (const std::unique_ptr<Asset>& asset : assetLoader.Get())
+    {
+        const Mesh* mesh = asset->m_mesh.get();
+        if (!mesh->HasAnimations() || mesh->GetVertices().empty())
+            continue;
+
+        const AnimationClip& clip = *mesh->GetAnimation(0);
+        const float tolerance = SKINNING_VALIDATION_TOLERANCE * glm::max(mesh->GetBoundingRadius(), 1.0f);
+
+        for (int mode = SKINNING_LINEAR_BLEND; mode <= SKINNING_SCALED_DUAL_QUAT; mode++)
+        {
+            const Skinning_Mode skinning = static_cast<Skinning_Mode>(mode);
+
+            // A failed skinning leaves the vertices empty, which the comparison reports as -1
+            float max_error = 0.0f;
+            for (int step = 0; step < SKINNING_VALIDATION_STEPS && max_error >= 0.0f; step++)
+            {
+                mesh->EvaluatePose(pose, clip, clip.duration * step / SKINNING_VALIDATION_STEPS, INTERPOLATION_LINEAR, skinning, nullptr);
+                skinned.Resize(0);
+                SkinVertices(mesh->GetVertices(), pose, skinning, skinned, &workers);
+
+                const float error = ValidateSkinning(mesh->GetVertices(), pose, skinning, skinned);
+                max_error = error < 0.0f ? error : glm::max(max_error, error);
+            }
+
+            const bool passed = max_error >= 0.0f && max_error <= tolerance;
+            valid = valid && passed;
+            std::cout << (passed ? "" : "ERROR::") << "CPU skinning of " << asset->m_name << " (" << skinning_names[mode] << "): max error " << max_error
+                << (passed ? " within " : " exceeds ") << tolerance << std::endl;
+        }
+    }
+
+    return valid;
 }
 
 // Process Keyboard Input
@@ -354,7 +505,8 @@ void processKeyboardInput(GLFWwindow* window)
     // Start/Pause Animation
     if (p_down && glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
     {
-        anim_player.is_playing = !anim_player.is_playing;
+        for (AnimationPlayer& player : anim_players)
+            player.is_playing = !player.is_playing;
 
         p_down = false;
     }
@@ -362,7 +514,8 @@ void processKeyboardInput(GLFWwindow* window)
     // Reset Animation
     if (r_down && glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE)
     {
-        anim_player.ResetTime();
+        for (AnimationPlayer& player : anim_players)
+            player.ResetTime();
 
         r_down = false;
     }